@@ -0,0 +1,78 @@
+#ifndef ABRREADER_H
+#define ABRREADER_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QImage>
+#include <QRect>
+#include <QString>
+#include <vector>
+
+// Reads sampled brushes from Photoshop ABR libraries: versions 1 and 2, the
+// files AbrWriter exports, and the 8BIM "samp" section of versions 6 to 10.
+// The file is memory-mapped and open() only walks the brush headers, jumping
+// from one brush to the next by its size field, so opening a large library
+// touches a few bytes per brush. Pixels are decoded when a brush is asked for.
+class AbrReader {
+public:
+    struct BrushInfo {
+        QString name;    // Empty in version 6+, which keeps names in its descriptor section
+        QRect bounds;
+        int depth = 8;   // Bits per sample, 8 or 16
+        int spacing = 0; // Percent; 0 where the file does not say
+    };
+
+    AbrReader() = default;
+    ~AbrReader();
+    AbrReader(const AbrReader&) = delete;
+    AbrReader& operator=(const AbrReader&) = delete;
+
+    bool open(const QString& filename);
+    // ABR data held in memory, e.g. from AbrWriter::abrData(); shared, not copied
+    bool open(const QByteArray& data);
+    void close();
+    bool isOpen() const { return m_data != nullptr; }
+    QString errorString() const { return m_error; }
+
+    int version() const { return m_version; }
+    int count() const { return (int)m_entries.size(); }
+    const BrushInfo& brush(int index) const { return m_entries[index].info; }
+
+    // Alpha8 coverage of a brush (255 = full ink), decoded on each call; null
+    // if its data is corrupt. Safe to call from several threads at once.
+    QImage image(int index) const;
+
+    // Particle tip source: an image file, or brush N of an ABR library
+    // written "library.abr#N" (a bare library path means its first brush)
+    static QImage loadTip(const QString& source);
+
+private:
+    enum class Compression {
+        Raw,
+        RowCounts, // PackBits with a table of row byte counts (Photoshop)
+        Packed     // PackBits rows back to back (AbrWriter)
+    };
+
+    struct Entry {
+        BrushInfo info;
+        Compression compression = Compression::Raw;
+        qint64 data = 0; // Offset of the pixel data, or of the row byte counts
+        qint64 end = 0;  // Offset one past the brush
+    };
+
+    bool index();
+    bool indexClassic(bool exported);
+    bool indexSamples();
+    bool valid(const Entry& entry) const;
+    bool fail(const QString& error);
+
+    QFile m_file;
+    QByteArray m_buffer;
+    const uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    int m_version = 0;
+    QString m_error;
+    std::vector<Entry> m_entries;
+};
+
+#endif // ABRREADER_H
@@ -2,11 +2,48 @@
 #define ABRWRITER_H
 
 #include <QString>
+#include <QStringList>
 #include <QImage>
+#include <QFile>
+#include <QDataStream>
 
 class AbrWriter {
 public:
     static bool writeAbr(const QString& filename, const QImage& brushImage, const QString& brushName, int spacingPercent = 25);
+    // Several brushes in one file, e.g. a variation grid
+    static bool writeAbr(const QString& filename, const QList<QImage>& brushImages, const QStringList& brushNames, int spacingPercent = 25);
+    // Single-brush ABR file contents, empty on failure
+    static QByteArray abrData(const QImage& brushImage, const QString& brushName, int spacingPercent = 25);
+};
+
+// Streams sampled brushes row by row. Each brush size field is patched once
+// its rows are written, so no image ever has to be held in memory.
+class AbrStreamWriter {
+public:
+    // Single brush file
+    bool begin(const QString& filename, int width, int height, const QString& brushName, int spacingPercent = 25);
+    // File of brushCount brushes, each started with beginBrush()
+    bool open(const QString& filename, int brushCount);
+    // Same into an open, seekable device (e.g. a QBuffer); finish() leaves it open
+    bool open(QIODevice* device, int brushCount);
+    bool beginBrush(int width, int height, const QString& brushName, int spacingPercent = 25);
+    // Alpha8 coverage rows of the current brush, top to bottom
+    bool writeRows(const uchar* coverage, qsizetype stride, int rows);
+    bool finish();
+
+private:
+    bool endBrush();
+
+    QFile m_file;
+    QIODevice* m_device = nullptr;
+    QDataStream m_out;
+    qint64 m_sizePos = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_rowsWritten = 0;
+    int m_brushCount = 0;
+    int m_brushesWritten = 0;
+    bool m_inBrush = false;
 };
 
 #endif // ABRWRITER_H
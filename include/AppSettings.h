@@ -14,7 +14,12 @@ public:
     Language getLanguage() const;
     void setLanguage(Language lang);
 
+    // Memory the caches may use before they evict (MemoryTracker); 0 is no limit
+    int getMemoryCeilingMb() const;
+    void setMemoryCeilingMb(int megabytes);
+
 private:
     AppSettings();
     Language m_language = Chinese;
+    int m_memoryCeilingMb = 0;
 };
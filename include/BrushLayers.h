@@ -0,0 +1,223 @@
+#pragma once
+
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <utility>
+#include <vector>
+#include "MemoryTracker.h"
+#include "RasterKernels.h"
+#include "TextureGenerator.h"
+
+// A brush made of several emitter layers, e.g. a dense core plus sparse
+// speckle, each with its own generator parameters. Every layer is placed and
+// rendered on its own and its coverage is cached, so editing one layer only
+// re-renders that layer. The brush is the composite of the visible layers,
+// first layer at the bottom. While the tracked memory is over the
+// MemoryTracker ceiling, cached renders are dropped, least recently rendered
+// first; their placements stay, so a dropped layer is redrawn unchanged.
+class BrushLayers {
+public:
+    struct Layer {
+        TextureGenerator::Parameters params{};
+        int blendMode = RasterKernels::BlendOver;
+        int opacity = 255; // 0-255
+        bool visible = true;
+    };
+
+    int count() const { return (int)m_entries.size(); }
+    const Layer& layer(int index) const { return m_entries[index].layer; }
+
+    // New settings for one layer; the next composite() re-renders it alone
+    void setLayer(int index, const Layer& layer) {
+        m_entries[index].layer = layer;
+        m_entries[index].stale = true;
+    }
+
+    // Blending changes keep the cached render and only recomposite
+    void setBlending(int index, int blendMode, int opacity, bool visible) {
+        Layer& layer = m_entries[index].layer;
+        layer.blendMode = blendMode;
+        layer.opacity = std::clamp(opacity, 0, 255);
+        layer.visible = visible;
+    }
+
+    void insertLayer(int index, const Layer& layer) {
+        Entry entry;
+        entry.layer = layer;
+        m_entries.insert(m_entries.begin() + std::clamp(index, 0, count()), std::move(entry));
+    }
+
+    void removeLayer(int index) {
+        m_entries.erase(m_entries.begin() + index);
+    }
+
+    void moveLayer(int from, int to) {
+        Entry entry = std::move(m_entries[from]);
+        m_entries.erase(m_entries.begin() + from);
+        m_entries.insert(m_entries.begin() + std::clamp(to, 0, count()), std::move(entry));
+    }
+
+    void clear() { m_entries.clear(); }
+
+    // Parameters for the same layer on another canvas: particle sizes scale with it
+    static TextureGenerator::Parameters resized(TextureGenerator::Parameters params, int canvasSize) {
+        double scale = (double)canvasSize / params.canvasSize;
+        params.canvasSize = canvasSize;
+        params.sizeMean = std::max(1, (int)std::round(params.sizeMean * scale));
+        return params;
+    }
+
+    // Blends a layer's Alpha8 coverage into an Alpha8 composite of the same size
+    static void blend(QImage& composite, const QImage& coverage, const Layer& layer) {
+        for (int y = 0; y < composite.height(); ++y) {
+            RasterKernels::blendSpan<uint8_t>(layer.blendMode, composite.scanLine(y), coverage.constScanLine(y),
+                                              composite.width(), layer.opacity);
+        }
+    }
+
+    // Placement of a layer's last render, so exports draw the same particles
+    const std::vector<TextureGenerator::Particle>& particles(int index) const {
+        return m_entries[index].particles;
+    }
+
+    // ARGB32 composite of the visible layers, rendering stale layers first.
+    // All layers share the canvas size of the first one.
+    QImage composite() {
+        if (m_entries.empty()) return QImage();
+        const int size = m_entries.front().layer.params.canvasSize;
+
+        QImage result(size, size, QImage::Format_Alpha8);
+        TrackedBytes resultBytes(MemoryTracker::Canvas, result.sizeInBytes());
+        result.fill(0);
+        for (Entry& entry : m_entries) {
+            if (!entry.layer.visible) continue;
+            if (entry.evicted && !entry.stale) {
+                setCoverage(entry, TextureGenerator::renderCoverage(entry.layer.params, entry.particles));
+            }
+            if (entry.stale || entry.coverage.width() != size) {
+                entry.particles = TextureGenerator::place(entry.layer.params);
+                entry.particleBytes.set((qint64)(entry.particles.capacity() * sizeof(TextureGenerator::Particle)));
+                setCoverage(entry, TextureGenerator::renderCoverage(entry.layer.params, entry.particles));
+                entry.stale = false;
+            }
+            if (entry.coverage.width() != size) continue; // Canvas sizes out of step, skip until re-rendered
+            blend(result, entry.coverage, entry.layer);
+        }
+        QImage image = result.convertToFormat(QImage::Format_ARGB32);
+        result = QImage();
+        resultBytes.set(0);
+        evictToCeiling();
+        return image;
+    }
+
+    // 16-bit export of the last composite: each visible layer is rendered in
+    // high precision from its cached placement and blended at 16 bits.
+    // Grayscale16 transmittance, black ink on white, like the single render.
+    QImage renderGrayscale16() const {
+        if (m_entries.empty()) return QImage();
+        const int size = m_entries.front().layer.params.canvasSize;
+
+        QImage result(size, size, QImage::Format_Grayscale16);
+        TrackedBytes resultBytes(MemoryTracker::Canvas, result.sizeInBytes());
+        result.fill(0); // Blended as coverage, inverted at the end
+        std::vector<uint16_t> coverage(size);
+        for (const Entry& entry : m_entries) {
+            if (!entry.layer.visible || entry.stale || entry.layer.params.canvasSize != size) continue;
+            QImage layer = TextureGenerator::renderGrayscale16(entry.layer.params, entry.particles);
+            for (int y = 0; y < size; ++y) {
+                const uint16_t* transmittance = reinterpret_cast<const uint16_t*>(layer.constScanLine(y));
+                for (int x = 0; x < size; ++x) coverage[x] = 65535 - transmittance[x];
+                RasterKernels::blendSpan<uint16_t>(entry.layer.blendMode, reinterpret_cast<uint16_t*>(result.scanLine(y)),
+                                                   coverage.data(), size, entry.layer.opacity);
+            }
+        }
+        for (int y = 0; y < size; ++y) {
+            uint16_t* row = reinterpret_cast<uint16_t*>(result.scanLine(y));
+            for (int x = 0; x < size; ++x) row[x] = 65535 - row[x];
+        }
+        return result;
+    }
+
+    // Out-of-core render of the brush at another canvas size, with particle
+    // sizes scaled to match. Every visible layer is placed anew and the
+    // layers are rendered band by band in lockstep, so peak memory is one
+    // band per layer plus the particle lists.
+    bool renderBands(int canvasSize, const TextureGenerator::BandSink& sink,
+                     int bandHeight = TextureGenerator::kBandHeight) const {
+        std::vector<const Layer*> visible;
+        for (const Entry& entry : m_entries) {
+            if (entry.layer.visible) visible.push_back(&entry.layer);
+        }
+        if (visible.empty() || canvasSize <= 0) return false;
+
+        std::vector<std::vector<TextureGenerator::Particle>> placements(visible.size());
+        std::vector<std::unique_ptr<TextureGenerator::BandRenderer>> renderers;
+        TrackedBytes placementBytes(MemoryTracker::Paths);
+        for (size_t i = 0; i < visible.size(); ++i) {
+            TextureGenerator::Parameters params = resized(visible[i]->params, canvasSize);
+            placements[i] = TextureGenerator::place(params);
+            placementBytes.set(placementBytes.bytes() + (qint64)(placements[i].capacity() * sizeof(TextureGenerator::Particle)));
+            renderers.push_back(std::make_unique<TextureGenerator::BandRenderer>(params, placements[i], bandHeight));
+        }
+
+        // Layers share the brush-wide anti-aliasing, so their bands line up
+        const int rowsPerBand = renderers.front()->bandHeight();
+        QImage band(canvasSize, rowsPerBand, QImage::Format_Alpha8);
+        TrackedBytes bandBytes(MemoryTracker::Canvas, band.sizeInBytes());
+        for (int b = 0; b < renderers.front()->bandCount(); ++b) {
+            band.fill(0);
+            int bandY = 0;
+            int bandRows = 0;
+            for (size_t i = 0; i < renderers.size(); ++i) {
+                renderers[i]->renderBand(b, [&](const uchar* bits, qsizetype stride, int y, int rows) {
+                    for (int r = 0; r < rows; ++r) {
+                        RasterKernels::blendSpan<uint8_t>(visible[i]->blendMode, band.scanLine(r), bits + r * stride,
+                                                          canvasSize, visible[i]->opacity);
+                    }
+                    bandY = y;
+                    bandRows = rows;
+                    return true;
+                });
+            }
+            if (!sink(band.constBits(), band.bytesPerLine(), bandY, bandRows)) return false;
+        }
+        return true;
+    }
+
+private:
+    struct Entry {
+        Layer layer;
+        bool stale = true;
+        bool evicted = false; // Coverage dropped under the memory ceiling, particles kept
+        QImage coverage; // Alpha8
+        std::vector<TextureGenerator::Particle> particles;
+        quint64 renderSerial = 0; // Order of the last render, for eviction
+        TrackedBytes coverageBytes{MemoryTracker::Cache};
+        TrackedBytes particleBytes{MemoryTracker::Paths};
+    };
+
+    void setCoverage(Entry& entry, QImage coverage) {
+        entry.coverage = std::move(coverage);
+        entry.coverageBytes.set(entry.coverage.sizeInBytes());
+        entry.evicted = false;
+        entry.renderSerial = ++m_renderSerial;
+    }
+
+    void evictToCeiling() {
+        while (MemoryTracker::instance().overCeiling()) {
+            Entry* oldest = nullptr;
+            for (Entry& entry : m_entries) {
+                if (!entry.coverage.isNull() && (!oldest || entry.renderSerial < oldest->renderSerial)) oldest = &entry;
+            }
+            if (!oldest) return;
+            oldest->coverage = QImage();
+            oldest->coverageBytes.set(0);
+            oldest->evicted = true;
+        }
+    }
+
+    std::vector<Entry> m_entries;
+    quint64 m_renderSerial = 0;
+};
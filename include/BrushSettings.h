@@ -0,0 +1,193 @@
+#pragma once
+
+#include <QImage>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QString>
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "AbrReader.h"
+#include "BrushLayers.h"
+#include "DensityMap.h"
+#include "StampBlitter.h"
+#include "TextureGenerator.h"
+
+// Reads preset JSON (the editor's serializeSettings schema) without the
+// editor, for headless rendering, and for the editor itself when it loads a
+// preset. Missing keys take the editor's defaults and values are clamped to
+// its control ranges, which are the ones listed here. A layer inherits any
+// key it does not set from the layer below it.
+class BrushSettings {
+public:
+    using DensityMapLoader = std::function<std::shared_ptr<const DensityMap>(const QString& path)>;
+    using StampLoader = std::function<std::shared_ptr<const StampMipChain>(const QString& source)>;
+
+    struct IntField {
+        const char* key;
+        int TextureGenerator::Parameters::* member; // Null for the seed, which is unsigned
+        int min;
+        int max;
+        int value; // Default
+    };
+
+    // Range and default of the slider behind one of the preset's integer keys
+    static const IntField& intField(const char* key) {
+        const std::vector<IntField>& fields = intFields();
+        return *std::find_if(fields.begin(), fields.end(),
+                             [key](const IntField& field) { return std::strcmp(field.key, key) == 0; });
+    }
+
+    static QString defaultRadiusExpression() { return "1 + 0.25 * sin(5 * t + i)"; }
+
+    // The editor's initial control values
+    static TextureGenerator::Parameters defaults() {
+        static const std::shared_ptr<const ShapeExpression> radiusExpression =
+            TextureGenerator::compileRadiusExpression(defaultRadiusExpression());
+        TextureGenerator::Parameters params{};
+        for (const IntField& field : intFields()) {
+            if (field.member) params.*field.member = field.value;
+        }
+        params.distType = 0;
+        params.shapeId = 0;
+        params.seed = (quint32)intField("seed").value;
+        params.supersampling = 0;
+        params.highPrecision = false;
+        params.radiusExpression = radiusExpression;
+        return params;
+    }
+
+    // Layers of a preset, bottom first; presets from before layers hold one
+    // layer at the top level. settings, if given, receives the control state
+    // of each layer (the editor's layerSettings schema) as it was read.
+    static std::vector<BrushLayers::Layer> layers(const QJsonObject& json, const DensityMapLoader& loadMap = {},
+                                                  const StampLoader& loadStamp = {},
+                                                  std::vector<QJsonObject>* settings = nullptr) {
+        TextureGenerator::Parameters params = defaults();
+        readInt(json, intField("canvasSize"), params.canvasSize);
+        readChoice(json, "supersampling", params.supersampling, {0, 1, 2, 4, 8});
+        if (json.contains("highPrecision")) params.highPrecision = json["highPrecision"].toBool();
+
+        QJsonArray array = json["layers"].toArray();
+        if (array.isEmpty()) array.append(json);
+
+        // Paths and formulas, which the parameters only hold loaded or compiled
+        QJsonObject sources{{"densityMap", QString()}, {"stampImage", QString()},
+                            {"radiusExpression", defaultRadiusExpression()}, {"waveExpression", QString()}};
+        std::vector<BrushLayers::Layer> result;
+        if (settings) settings->clear();
+        for (const QJsonValue& value : array) {
+            QJsonObject layerJson = value.toObject();
+            applyLayer(layerJson, params, loadMap, loadStamp);
+            BrushLayers::Layer layer;
+            layer.params = params;
+            layer.blendMode = std::clamp(layerJson.value("blendMode").toInt(RasterKernels::BlendOver),
+                                         (int)RasterKernels::BlendOver, (int)RasterKernels::BlendErase);
+            layer.opacity = std::clamp(layerJson.value("layerOpacity").toInt(255), 0, 255);
+            layer.visible = layerJson.value("visible").toBool(true);
+            result.push_back(layer);
+
+            if (!settings) continue;
+            for (const QString& key : sources.keys()) {
+                if (layerJson.contains(key)) sources[key] = layerJson[key].toString();
+            }
+            if (!params.densityMap) sources["densityMap"] = QString(); // Did not load
+            if (!params.stampImage) sources["stampImage"] = QString();
+            settings->push_back(layerSettings(params, sources));
+        }
+        return result;
+    }
+
+    // Brush spacing (%) for ABR output
+    static int spacing(const QJsonObject& json) {
+        int spacing = 25;
+        readInt(json, "spacing", spacing, 1, 1000);
+        return spacing;
+    }
+
+private:
+    // Keys, ranges and defaults of the editor's sliders
+    static const std::vector<IntField>& intFields() {
+        static const std::vector<IntField> fields = {
+            {"canvasSize", &TextureGenerator::Parameters::canvasSize, 64, 2048, 500},
+            {"count", &TextureGenerator::Parameters::count, 1, 1000000, 1000},
+            {"sizeMean", &TextureGenerator::Parameters::sizeMean, 1, 100, 5},
+            {"sizeJitter", &TextureGenerator::Parameters::sizeJitter, 0, 100, 50},
+            {"opacityMean", &TextureGenerator::Parameters::opacityMean, 1, 255, 128},
+            {"opacityJitter", &TextureGenerator::Parameters::opacityJitter, 0, 100, 50},
+            {"roundness", &TextureGenerator::Parameters::roundness, 1, 100, 100},
+            {"angle", &TextureGenerator::Parameters::angle, 0, 360, 0},
+            {"falloff", &TextureGenerator::Parameters::falloff, 0, 100, 0},
+            {"distSquareness", &TextureGenerator::Parameters::distributionSquareness, 0, 100, 0},
+            {"distJitter", &TextureGenerator::Parameters::distJitter, 0, 100, 0},
+            {"polygonSides", &TextureGenerator::Parameters::polygonSides, 3, 16, 5},
+            {"edgeFreq", &TextureGenerator::Parameters::shapeEdgeFreq, 0, 50, 0},
+            {"edgeAmp", &TextureGenerator::Parameters::shapeEdgeAmp, 0, 100, 0},
+            {"warpFreq", &TextureGenerator::Parameters::shapeWarpFreq, 1, 20, 1},
+            {"warpAmp", &TextureGenerator::Parameters::shapeWarpAmp, 0, 100, 0},
+            {"waveThreshold", &TextureGenerator::Parameters::waveThreshold, 0, 100, 50},
+            {"particleAngle", &TextureGenerator::Parameters::particleAngle, 0, 360, 0},
+            {"particleAngleJitter", &TextureGenerator::Parameters::particleAngleJitter, 0, 100, 0},
+            {"particleRoundness", &TextureGenerator::Parameters::particleRoundness, 1, 100, 100},
+            {"seed", nullptr, 0, 9999, 0},
+        };
+        return fields;
+    }
+
+    static void readInt(const QJsonObject& json, const char* key, int& value, int min, int max) {
+        if (json.contains(key)) value = std::clamp(json[key].toInt(), min, max);
+    }
+    static void readInt(const QJsonObject& json, const IntField& field, int& value) {
+        readInt(json, field.key, value, field.min, field.max);
+    }
+
+    // Like a combo box: unknown values leave the setting unchanged
+    static void readChoice(const QJsonObject& json, const char* key, int& value, std::initializer_list<int> choices) {
+        if (!json.contains(key)) return;
+        int choice = json[key].toInt();
+        if (std::find(choices.begin(), choices.end(), choice) != choices.end()) value = choice;
+    }
+
+    static void applyLayer(const QJsonObject& json, TextureGenerator::Parameters& params, const DensityMapLoader& loadMap,
+                           const StampLoader& loadStamp) {
+        for (const IntField& field : intFields()) {
+            if (!field.member || field.member == &TextureGenerator::Parameters::canvasSize) continue; // Seed, brush-wide
+            readInt(json, field, params.*field.member);
+        }
+        readChoice(json, "distType", params.distType, {0, 1, 2, 3, 4});
+        readChoice(json, "shapeId", params.shapeId, {0, 1, 2, 3, 4, 5, 6});
+        int seed = (int)params.seed;
+        readInt(json, intField("seed"), seed);
+        params.seed = (quint32)seed;
+        if (json.contains("densityMap")) {
+            QString path = json["densityMap"].toString();
+            if (path.isEmpty()) params.densityMap = nullptr;
+            else params.densityMap = loadMap ? loadMap(path) : DensityMap::fromImage(QImage(path));
+        }
+        if (json.contains("stampImage")) {
+            QString source = json["stampImage"].toString();
+            if (source.isEmpty()) params.stampImage = nullptr;
+            else params.stampImage = loadStamp ? loadStamp(source) : StampMipChain::fromTip(AbrReader::loadTip(source));
+        }
+        // Formulas that do not compile are dropped, as the editor does
+        if (json.contains("radiusExpression")) {
+            params.radiusExpression = TextureGenerator::compileRadiusExpression(json["radiusExpression"].toString());
+        }
+        if (json.contains("waveExpression")) {
+            params.waveExpression = TextureGenerator::compileWaveExpression(json["waveExpression"].toString());
+        }
+    }
+
+    // Control state of a layer read into params, with its paths and formulas
+    static QJsonObject layerSettings(const TextureGenerator::Parameters& params, QJsonObject sources) {
+        for (const IntField& field : intFields()) {
+            if (field.member == &TextureGenerator::Parameters::canvasSize) continue; // Brush-wide
+            sources[field.key] = field.member ? params.*field.member : (int)params.seed;
+        }
+        sources["distType"] = params.distType;
+        sources["shapeId"] = params.shapeId;
+        return sources;
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QImage>
+#include <QPointF>
+#include <QRandomGenerator>
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+// Grayscale density map for image-driven particle placement.
+// The map is turned into a Walker/Vose alias table once, after which every
+// sample costs one table lookup regardless of the map size.
+class DensityMap {
+public:
+    // Brighter (and more opaque) pixels attract more particles.
+    // Large maps are reduced to maxSide to bound the table size.
+    static std::shared_ptr<const DensityMap> fromImage(const QImage& source, int maxSide = 1024) {
+        if (source.isNull()) return nullptr;
+
+        QImage image = source;
+        if (image.width() > maxSide || image.height() > maxSide) {
+            image = image.scaled(maxSide, maxSide, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        image = image.convertToFormat(QImage::Format_ARGB32);
+
+        auto map = std::make_shared<DensityMap>();
+        map->m_width = image.width();
+        map->m_height = image.height();
+
+        int n = map->m_width * map->m_height;
+        std::vector<double> weights(n);
+        double total = 0.0;
+        for (int y = 0; y < map->m_height; ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            for (int x = 0; x < map->m_width; ++x) {
+                double w = qGray(line[x]) * qAlpha(line[x]) / (255.0 * 255.0);
+                weights[y * map->m_width + x] = w;
+                total += w;
+            }
+        }
+        if (total <= 0.0) return nullptr;
+
+        map->buildAliasTable(weights, total);
+        return map;
+    }
+
+    int width() const { return m_width; }
+    int height() const { return m_height; }
+
+    // Point in [-1, 1] on the longer side, aspect ratio preserved
+    QPointF sample(QRandomGenerator* rng) const {
+        int n = (int)m_prob.size();
+        double pick = rng->generateDouble() * n;
+        int cell = std::min((int)pick, n - 1);
+        if (pick - cell >= m_prob[cell]) cell = m_alias[cell];
+
+        // Uniform position inside the chosen pixel
+        double px = (cell % m_width) + rng->generateDouble();
+        double py = (cell / m_width) + rng->generateDouble();
+
+        double side = std::max(m_width, m_height);
+        return QPointF((px - m_width / 2.0) / side * 2.0, (py - m_height / 2.0) / side * 2.0);
+    }
+
+private:
+    // Vose's method: split cells into under- and over-full, then pair them up
+    void buildAliasTable(const std::vector<double>& weights, double total) {
+        int n = (int)weights.size();
+        m_prob.assign(n, 1.0f);
+        m_alias.resize(n);
+
+        std::vector<double> scaled(n);
+        std::vector<int> small, large;
+        small.reserve(n);
+        large.reserve(n);
+        for (int i = 0; i < n; ++i) {
+            scaled[i] = weights[i] * n / total;
+            m_alias[i] = i;
+            if (scaled[i] < 1.0) small.push_back(i);
+            else large.push_back(i);
+        }
+
+        while (!small.empty() && !large.empty()) {
+            int s = small.back();
+            small.pop_back();
+            int l = large.back();
+
+            m_prob[s] = (float)scaled[s];
+            m_alias[s] = l;
+
+            scaled[l] = (scaled[l] + scaled[s]) - 1.0;
+            if (scaled[l] < 1.0) {
+                large.pop_back();
+                small.push_back(l);
+            }
+        }
+        // Whatever is left is full up to rounding error
+        for (int i : large) m_prob[i] = 1.0f;
+        for (int i : small) m_prob[i] = 1.0f;
+    }
+
+    int m_width = 0;
+    int m_height = 0;
+    std::vector<float> m_prob;
+    std::vector<int> m_alias;
+};
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <QImage>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "BrushLayers.h"
+#include "PresetMorph.h"
+#include "TextureGenerator.h"
+
+// Keyframed brush animation for frame sequences. A key holds the whole layer
+// stack at one frame; frames in between interpolate every parameter field
+// like PresetMorph does. Each layer track uses one fixed seed so particles
+// move instead of re-randomizing from frame to frame.
+class KeyframeAnimation {
+public:
+    using Stack = std::vector<BrushLayers::Layer>;
+
+    // Receives finished Alpha8 coverage frames in frame order.
+    // Returning false cancels the render.
+    using FrameSink = std::function<bool(int frame, const QImage& coverage)>;
+
+    void setKey(int frame, const Stack& layers) { m_keys[std::max(0, frame)] = layers; }
+    bool removeKey(int frame) { return m_keys.erase(frame) > 0; }
+    void clear() { m_keys.clear(); }
+    const std::map<int, Stack>& keys() const { return m_keys; }
+    bool isEmpty() const { return m_keys.empty(); }
+
+    // Frame size of the sequence: the first key's canvas
+    int canvasSize() const {
+        return m_keys.empty() || m_keys.begin()->second.empty() ? 0 : m_keys.begin()->second.front().params.canvasSize;
+    }
+
+    // Last keyed frame; a sequence usually runs from 0 to here
+    int lastFrame() const { return m_keys.empty() ? 0 : m_keys.rbegin()->first; }
+
+    // Brush at a frame. Frames before the first or after the last key hold it.
+    Stack layersAt(int frame) const {
+        if (m_keys.empty()) return {};
+        auto next = m_keys.lower_bound(frame);
+        if (next == m_keys.begin()) return normalized(next->second);
+        if (next == m_keys.end()) return normalized(std::prev(next)->second);
+        auto prev = std::prev(next);
+        return interpolate(prev->second, next->second, (double)(frame - prev->first) / (next->first - prev->first));
+    }
+
+    // Single frame, ARGB32, for previews
+    QImage renderFrame(int frame) const {
+        return composite(layersAt(frame), {}).convertToFormat(QImage::Format_ARGB32);
+    }
+
+    // Renders frames [first, first + count) on all cores. Workers take frames
+    // in order and at most a few frames run ahead of the sink, so memory
+    // stays bounded however long the sequence is. Placement is shared by all
+    // frames of a key span in which only shape parameters animate.
+    bool renderFrames(int first, int count, const FrameSink& sink, int threads = 0) const {
+        if (m_keys.empty() || count <= 0) return false;
+        if (threads <= 0) threads = (int)std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, count);
+        const int window = 2 * threads;
+        const std::vector<Span> spans = placementSpans();
+
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable space;
+        std::map<int, QImage> finished;
+        int nextFrame = 0;
+        int delivered = 0;
+        std::atomic<bool> stop{false};
+
+        auto worker = [&]() {
+            for (;;) {
+                int f;
+                {
+                    std::unique_lock<std::mutex> lock(mutex);
+                    space.wait(lock, [&] { return stop || nextFrame >= count || nextFrame - delivered < window; });
+                    if (stop || nextFrame >= count) return;
+                    f = nextFrame++;
+                }
+                QImage coverage = composite(layersAt(first + f), spanPlacements(spans, first + f));
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    finished[f] = std::move(coverage);
+                }
+                ready.notify_all();
+            }
+        };
+
+        std::vector<std::thread> pool;
+        for (int i = 0; i < threads; ++i) pool.emplace_back(worker);
+
+        bool completed = true;
+        for (int f = 0; f < count && completed; ++f) {
+            QImage coverage;
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                ready.wait(lock, [&] { return finished.count(f) > 0; });
+                coverage = std::move(finished[f]);
+                finished.erase(f);
+                delivered = f + 1;
+            }
+            space.notify_all();
+            completed = sink(first + f, coverage);
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stop = true;
+        }
+        space.notify_all();
+        for (std::thread& thread : pool) thread.join();
+        return completed;
+    }
+
+private:
+    using Placement = std::shared_ptr<const std::vector<TextureGenerator::Particle>>;
+
+    // Frames [begin, end] between two keys, with the placement of every
+    // layer whose placement does not change over the span (null otherwise)
+    struct Span {
+        int begin;
+        int end;
+        std::vector<Placement> placements;
+    };
+
+    // The first keyed seed of a layer holds for the whole track
+    quint32 trackSeed(size_t layer) const {
+        for (const auto& [frame, stack] : m_keys) {
+            if (layer < stack.size() && stack[layer].params.seed != 0) return stack[layer].params.seed;
+        }
+        return PresetMorph::seedFor(0, 0);
+    }
+
+    // Fixed track seeds, and the first key's canvas for every frame so a
+    // sequence has one frame size (canvas size is brush-wide, like in the editor)
+    Stack normalized(Stack stack) const {
+        const int size = canvasSize();
+        for (size_t i = 0; i < stack.size(); ++i) {
+            stack[i].params.seed = trackSeed(i);
+            if (size > 0) stack[i].params.canvasSize = size;
+        }
+        return stack;
+    }
+
+    // Layers are paired by position; one missing on a side fades in or out
+    Stack interpolate(const Stack& from, const Stack& to, double t) const {
+        Stack stack(std::max(from.size(), to.size()));
+        for (size_t i = 0; i < stack.size(); ++i) {
+            BrushLayers::Layer a = i < from.size() ? from[i] : PresetMorph::faded(to[i]);
+            BrushLayers::Layer b = i < to.size() ? to[i] : PresetMorph::faded(from[i]);
+            stack[i] = PresetMorph::interpolate(a, b, t);
+        }
+        return normalized(stack);
+    }
+
+    std::vector<Span> placementSpans() const {
+        std::vector<Span> spans;
+        auto it = m_keys.begin();
+        Stack from = normalized(it->second);
+        do {
+            auto next = std::next(it) == m_keys.end() ? it : std::next(it);
+            Stack to = normalized(next->second);
+
+            Span span{it->first, next->first, {}};
+            for (size_t i = 0; i < std::max(from.size(), to.size()); ++i) {
+                if (i >= from.size() || i >= to.size() || !TextureGenerator::samePlacement(from[i].params, to[i].params)) {
+                    span.placements.push_back(nullptr);
+                } else if (!spans.empty() && i < spans.back().placements.size() && spans.back().placements[i]) {
+                    // Continues the previous span's placement, which ends on this key
+                    span.placements.push_back(spans.back().placements[i]);
+                } else {
+                    span.placements.push_back(std::make_shared<const std::vector<TextureGenerator::Particle>>(
+                        TextureGenerator::place(from[i].params)));
+                }
+            }
+            spans.push_back(std::move(span));
+            from = std::move(to);
+            it = next;
+        } while (std::next(it) != m_keys.end());
+        return spans;
+    }
+
+    // Frames outside the keys hold the first or last key, which is the
+    // outer end of the first or last span
+    static const std::vector<Placement>& spanPlacements(const std::vector<Span>& spans, int frame) {
+        for (const Span& span : spans) {
+            if (frame <= span.end) return span.placements;
+        }
+        return spans.back().placements;
+    }
+
+    // Alpha8 composite of a stack; layers without a shared placement are placed here
+    static QImage composite(const Stack& stack, const std::vector<Placement>& placements) {
+        const int size = stack.empty() ? 0 : stack.front().params.canvasSize;
+        QImage result(size, size, QImage::Format_Alpha8);
+        result.fill(0);
+        for (size_t i = 0; i < stack.size(); ++i) {
+            const BrushLayers::Layer& layer = stack[i];
+            if (!layer.visible || layer.params.canvasSize != size) continue;
+            Placement placement = i < placements.size() ? placements[i] : nullptr;
+            QImage coverage = placement ? TextureGenerator::renderCoverage(layer.params, *placement)
+                                        : TextureGenerator::renderCoverage(layer.params, TextureGenerator::place(layer.params));
+            BrushLayers::blend(result, coverage, layer);
+        }
+        return result;
+    }
+
+    std::map<int, Stack> m_keys;
+};
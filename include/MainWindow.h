@@ -8,6 +8,7 @@
 #include <QVBoxLayout>
 #include <QHBoxLayout>
 #include <QComboBox>
+#include <QCheckBox>
 #include <QGroupBox>
 #include <QTabWidget>
 #include <QListWidget>
@@ -17,35 +18,127 @@
 #include <QJsonArray>
 #include <QDir>
 #include <QFileInfo>
+#include <QThreadPool>
+#include <QElapsedTimer>
 #include "PreviewWidget.h"
+#include "StrokePreviewWidget.h"
 #include "AppSettings.h"
+#include "DensityMap.h"
+#include "TextureGenerator.h"
+#include "BrushLayers.h"
+#include "MemoryTracker.h"
+#include "PresetMorph.h"
+#include "KeyframeAnimation.h"
+#include "VariationGrid.h"
+#include <functional>
+#include <memory>
 
 class MainWindow : public QMainWindow {
     Q_OBJECT
 public:
     explicit MainWindow(QWidget* parent = nullptr);
+    ~MainWindow() override;
 
     void setLanguage(AppSettings::Language lang);
     QString getStr(const QString& key);
 
+protected:
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private slots:
     void generateBrush();
     void exportPng();
+    void exportPng16();
+    void exportAbr();
+    void exportLarge();
     void copyToClipboard();
+    void loadDensityMap();
+    void loadStampImage();
+    void compileExpressions();
+
+    void selectLayer(int row);
+    void addLayer();
+    void removeLayer();
+    void updateLayerBlending();
 
     void savePreset();
     void loadPreset();
     void deletePreset();
     void refreshPresets();
 
+    void prepareMorph();
+    void scrubMorph();
+    void applyMorph();
+
+    void setKeyframe();
+    void removeKeyframe();
+    void clearKeyframes();
+    void previewFrame();
+    void exportFrames();
+
+    void renderVariations();
+    void newVariationSeeds();
+    void adoptVariation(QListWidgetItem* item);
+    void updateSweepRange();
+    void exportContactSheet();
+    void exportVariationsAbr();
+
 private:
     void setupUi();
+    void setupPresetsTab(QWidget* presetsTab);
+    void setupVariationsTab(QWidget* variationsTab);
+    void setupSettingsTab(QWidget* settingsTab);
+    void buildTab(int index);
+    void startFirstRender();
+    void reportStartup();
+    void ensureBrush();
+    void showBrush(const QImage& image);
+    void refreshMemoryStats();
+
+    // Text that follows the language: each setter runs now and again on
+    // every setLanguage(), which only swaps texts
+    void translated(std::function<void()> apply);
+    QLabel* translatedLabel(const QString& key);
+    template <typename Button> Button* translatedButton(const QString& key, QWidget* parent = nullptr);
+    QGroupBox* translatedGroup(const QString& key, QWidget* parent = nullptr);
+    void addTranslatedItem(QComboBox* combo, const QString& key, const QVariant& data);
+    void addTranslatedTab(QWidget* page, const QString& key);
     
     QJsonObject serializeSettings();
     void deserializeSettings(const QJsonObject& json);
+    QJsonObject layerSettings() const;
+    void applyLayerSettings(const QJsonObject& json);
+    std::vector<BrushLayers::Layer> presetLayers(const QJsonObject& json, std::vector<QJsonObject>* settings = nullptr) const;
+    std::shared_ptr<const DensityMap> densityMap(const QString& path) const;
+    std::shared_ptr<const StampMipChain> stampImage(const QString& source) const;
+    QJsonObject readPreset(const QString& name) const;
+    QJsonObject morphSettings(double t) const;
+    void refreshKeyframes();
+    void makeVariationGrid();
+    void moveLayer(int step);
+    void refreshLayerList();
+    void updateComposite();
+    bool setDensityMapPath(const QString& path);
+    bool setStampImagePath(const QString& source);
+    TextureGenerator::Parameters currentParameters() const;
 
     QImage m_brushImage;
+    TrackedBytes m_brushImageBytes{MemoryTracker::Cache};
+    QLabel* m_memoryLabel = nullptr; // Settings tab, built on first visit
+
+    // Emitter layers, first one at the bottom. The generator controls edit
+    // the current layer; the others keep their control state as JSON.
+    BrushLayers m_layers;
+    std::vector<QJsonObject> m_layerSettings;
+    int m_currentLayer = 0;
+    QListWidget* m_layerList;
+    QComboBox* m_blendCombo;
+    QSlider* m_layerOpacitySlider;
+    QCheckBox* m_layerVisibleCheck;
+
     PreviewWidget* m_previewWidget = nullptr;
+    StrokePreviewWidget* m_strokePreviewWidget = nullptr;
+    QSlider* m_spacingSlider;
     
     QSlider* m_countSlider;
     QSlider* m_sizeMeanSlider;
@@ -58,8 +151,16 @@ private:
     QSlider* m_distributionSquarenessSlider;
     QComboBox* m_distTypeCombo;
     QSlider* m_distJitterSlider;
+    QSlider* m_seedSlider;
+
+    QWidget* m_densityMapRow;
+    QLabel* m_densityMapLabel;
+    QString m_densityMapPath;
+    std::shared_ptr<const DensityMap> m_densityMap;
 
     QSlider* m_canvasSizeSlider;
+    QComboBox* m_antialiasingCombo;
+    QCheckBox* m_highPrecisionCheck;
 
     // Shape Synthesis Controls
     QComboBox* m_shapeCombo;
@@ -81,12 +182,40 @@ private:
     QWidget* m_waveThresholdRow;
     QSlider* m_waveThresholdSlider;
 
+    QWidget* m_stampImageRow;
+    QLabel* m_stampImageLabel;
+    QString m_stampImagePath; // Image file, or "library.abr#N"
+    std::shared_ptr<const StampMipChain> m_stampImage;
+
+    // Expression shape r(t, i) and wavetable z(u, v); an empty wavetable
+    // formula keeps the built-in one. Compiled when editing finishes.
+    QWidget* m_radiusExpressionRow;
+    QLineEdit* m_radiusExpressionEdit;
+    QLabel* m_radiusExpressionError;
+    std::shared_ptr<const ShapeExpression> m_radiusExpression;
+    QWidget* m_waveExpressionRow;
+    QLineEdit* m_waveExpressionEdit;
+    QLabel* m_waveExpressionError;
+    std::shared_ptr<const ShapeExpression> m_waveExpression;
+
     // Particle Transform Controls
     QSlider* m_particleAngleSlider;
     QSlider* m_particleAngleJitterSlider;
     QSlider* m_particleRoundnessSlider;
 
     bool m_isInitializing = true;
+    std::vector<std::function<void()>> m_translations;
+
+    // Tabs after the generator are built when first shown; null once built
+    std::vector<void (MainWindow::*)(QWidget*)> m_tabBuilders;
+
+    // Startup: the first render runs on a worker so the window paints first
+    QThreadPool m_renderPool;
+    QElapsedTimer m_startupClock;
+    qint64 m_firstPaintNs = -1;
+    qint64 m_firstRenderNs = -1;
+    QLabel* m_startupLabel = nullptr;
+    quint64 m_compositeSerial = 0;
     
     // Preset UI
     QTabWidget* m_tabWidget;
@@ -95,5 +224,35 @@ private:
     QPushButton* m_savePresetButton;
     QPushButton* m_loadPresetButton;
     QPushButton* m_deletePresetButton;
+
     QPushButton* m_refreshPresetsButton;
+
+    // Preset morph: both ends are placed once, the slider only re-rasterizes
+    QComboBox* m_morphFromCombo;
+    QComboBox* m_morphToCombo;
+    QSlider* m_morphSlider;
+    std::unique_ptr<PresetMorph> m_morph;
+    QJsonObject m_morphFrom;
+    QJsonObject m_morphTo;
+
+    // Keyframes hold the whole layer stack; they live for the session
+    KeyframeAnimation m_animation;
+    QSlider* m_frameSlider;
+    QLabel* m_frameLabel;
+    QLabel* m_keyframesLabel;
+
+    // Variations of the current layer, adopted by clicking a thumbnail
+    struct SweepControl {
+        VariationGrid::Field field;
+        QSlider* slider;
+    };
+    std::vector<SweepControl> m_sweepControls;
+    std::unique_ptr<VariationGrid> m_variations;
+    quint32 m_variationSeed = 1;
+    QListWidget* m_variationList;
+    QComboBox* m_sweepCombo;
+    QSlider* m_sweepFromSlider;
+    QSlider* m_sweepToSlider;
+    QSlider* m_gridRowsSlider;
+    QSlider* m_gridColumnsSlider;
 };
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <QtGlobal>
+#include <array>
+#include <atomic>
+#include <utility>
+
+// Bytes held by the large buffers of rendering and export, per stage, with
+// the high-water mark of each stage and of the total. Buffers register
+// through TrackedBytes for as long as they are alive, from any thread; the
+// counts cover those buffers, not every allocation of the process.
+// Caches compare the total against the ceiling and evict when it is over.
+class MemoryTracker {
+public:
+    enum Stage {
+        Canvas, // Coverage canvases, raster bands and composites
+        Stamp,  // Wavetable images and stamp mip chains
+        Paths,  // Particle lists and outline vertices
+        Encode, // PNG and ABR encoder buffers
+        Cache,  // Rendered images kept for reuse
+        StageCount
+    };
+
+    static MemoryTracker& instance() {
+        static MemoryTracker tracker;
+        return tracker;
+    }
+
+    static const char* stageName(int stage) {
+        static const char* const kNames[StageCount] = {"canvas", "stamp", "paths", "encode", "cache"};
+        return stage >= 0 && stage < StageCount ? kNames[stage] : "";
+    }
+
+    void add(Stage stage, qint64 bytes) {
+        if (bytes == 0) return;
+        raise(m_peak[stage], m_current[stage].fetch_add(bytes, std::memory_order_relaxed) + bytes);
+        raise(m_peakTotal, m_total.fetch_add(bytes, std::memory_order_relaxed) + bytes);
+    }
+
+    qint64 current(Stage stage) const { return m_current[stage].load(std::memory_order_relaxed); }
+    qint64 current() const { return m_total.load(std::memory_order_relaxed); }
+    qint64 peak(Stage stage) const { return m_peak[stage].load(std::memory_order_relaxed); }
+    qint64 peak() const { return m_peakTotal.load(std::memory_order_relaxed); }
+
+    // Starts a new high-water mark from the current usage, e.g. per render
+    void resetPeak() {
+        for (int s = 0; s < StageCount; ++s) m_peak[s].store(current((Stage)s), std::memory_order_relaxed);
+        m_peakTotal.store(current(), std::memory_order_relaxed);
+    }
+
+    // Bytes the caches may let the total grow to; 0 means no ceiling
+    qint64 ceiling() const { return m_ceiling.load(std::memory_order_relaxed); }
+    void setCeiling(qint64 bytes) { m_ceiling.store(qMax<qint64>(0, bytes), std::memory_order_relaxed); }
+    bool overCeiling() const {
+        qint64 limit = ceiling();
+        return limit > 0 && current() > limit;
+    }
+
+private:
+    MemoryTracker() = default;
+
+    static void raise(std::atomic<qint64>& peak, qint64 value) {
+        qint64 seen = peak.load(std::memory_order_relaxed);
+        while (value > seen && !peak.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {}
+    }
+
+    std::array<std::atomic<qint64>, StageCount> m_current{};
+    std::array<std::atomic<qint64>, StageCount> m_peak{};
+    std::atomic<qint64> m_total{0};
+    std::atomic<qint64> m_peakTotal{0};
+    std::atomic<qint64> m_ceiling{0};
+};
+
+// The bytes of one buffer, counted against a stage until set back to zero or
+// destroyed. A copy counts its bytes again, since most copies are deep;
+// implicitly shared QImage copies are counted twice until one of them goes.
+// A move hands the bytes over.
+class TrackedBytes {
+public:
+    explicit TrackedBytes(MemoryTracker::Stage stage, qint64 bytes = 0) : m_stage(stage) { set(bytes); }
+    TrackedBytes(const TrackedBytes& other) : m_stage(other.m_stage) { set(other.m_bytes); }
+    TrackedBytes& operator=(const TrackedBytes& other) {
+        if (this != &other) {
+            set(0);
+            m_stage = other.m_stage;
+            set(other.m_bytes);
+        }
+        return *this;
+    }
+    TrackedBytes(TrackedBytes&& other) noexcept : m_stage(other.m_stage), m_bytes(std::exchange(other.m_bytes, 0)) {}
+    TrackedBytes& operator=(TrackedBytes&& other) noexcept {
+        if (this != &other) {
+            set(0);
+            m_stage = other.m_stage;
+            m_bytes = std::exchange(other.m_bytes, 0);
+        }
+        return *this;
+    }
+    ~TrackedBytes() { set(0); }
+
+    void set(qint64 bytes) {
+        MemoryTracker::instance().add(m_stage, bytes - m_bytes);
+        m_bytes = bytes;
+    }
+    qint64 bytes() const { return m_bytes; }
+
+private:
+    MemoryTracker::Stage m_stage;
+    qint64 m_bytes = 0;
+};
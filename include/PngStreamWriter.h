@@ -0,0 +1,57 @@
+#ifndef PNGSTREAMWRITER_H
+#define PNGSTREAMWRITER_H
+
+#include <QString>
+#include <QFile>
+#include <QByteArray>
+#include <vector>
+#include "MemoryTracker.h"
+
+// Writes a brush PNG (8-bit gray + alpha, black ink) row by row, so images
+// far larger than memory can be encoded straight from a band renderer.
+// Rows are deflated incrementally with a small LZ77 / fixed Huffman encoder;
+// QImageWriter would need the whole image up front.
+class PngStreamWriter {
+public:
+    bool begin(const QString& filename, int width, int height);
+    // Alpha8 coverage rows, top to bottom
+    bool writeRows(const uchar* coverage, qsizetype stride, int rows);
+    bool finish();
+
+private:
+    void filterRow(const uchar* coverage);
+    void deflate(const uchar* data, int size, bool final);
+    void emitLiteral(int value);
+    void emitMatch(int length, int distance);
+    void putBits(quint32 bits, int count);
+    void putHuffman(quint32 code, int length);
+    bool writeChunk(const char* type, const QByteArray& data);
+    bool flushIdat(bool all);
+    void trackBuffers();
+
+    QFile m_file;
+    int m_width = 0;
+    int m_height = 0;
+    int m_rowsWritten = 0;
+    bool m_ok = false;
+
+    // Filtering: previous and current raw rows (filter byte excluded)
+    std::vector<uchar> m_prevRow;
+    std::vector<uchar> m_currRow;
+    std::vector<uchar> m_filtered; // Filter type byte + filtered row
+
+    // LZ77 state: a sliding window over the filtered stream
+    std::vector<uchar> m_window;
+    std::vector<int> m_head;
+    int m_pending = 0; // Start of the bytes not yet encoded
+    quint32 m_adlerA = 1;
+    quint32 m_adlerB = 0;
+
+    QByteArray m_idat;
+    quint32 m_bitBuffer = 0;
+    int m_bitCount = 0;
+
+    TrackedBytes m_bufferBytes{MemoryTracker::Encode};
+};
+
+#endif // PNGSTREAMWRITER_H
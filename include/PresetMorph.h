@@ -0,0 +1,165 @@
+#pragma once
+
+#include <QImage>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "BrushLayers.h"
+#include "TextureGenerator.h"
+
+// Interpolation between two brushes (layer stacks) for scrubbing. Both ends
+// are placed once with a shared fixed seed, so a particle keeps its random
+// draws on both sides; a frame then only blends the two placements and runs
+// the raster stage, and particles move continuously instead of re-randomizing.
+// Layers are paired by position; a layer missing on one side fades in or out.
+class PresetMorph {
+public:
+    // Canvas size used for draft frames while the slider is dragged
+    static constexpr int kDraftSize = 256;
+
+    PresetMorph(const std::vector<BrushLayers::Layer>& from, const std::vector<BrushLayers::Layer>& to) {
+        const size_t count = std::max(from.size(), to.size());
+        for (size_t i = 0; i < count; ++i) {
+            Track track;
+            track.from = i < from.size() ? from[i] : faded(to[i]);
+            track.to = i < to.size() ? to[i] : faded(from[i]);
+            track.from.params.seed = track.to.params.seed = seedFor(track.from.params.seed, track.to.params.seed);
+            track.fromParticles = TextureGenerator::place(track.from.params);
+            track.toParticles = TextureGenerator::place(track.to.params);
+
+            // Frames are drawn on the first preset's canvas
+            const double scale = (double)track.from.params.canvasSize / track.to.params.canvasSize;
+            if (scale != 1.0) {
+                track.toParticles = interpolate({}, track.toParticles, 1.0, scale);
+                track.to.params.canvasSize = track.from.params.canvasSize;
+            }
+            m_tracks.push_back(std::move(track));
+        }
+    }
+
+    int layerCount() const { return (int)m_tracks.size(); }
+
+    // The seed both ends are placed with: the first fixed one, or 1 when
+    // both presets re-randomize on every render
+    static quint32 seedFor(quint32 from, quint32 to) {
+        return from != 0 ? from : (to != 0 ? to : 1);
+    }
+
+    // Numeric fields are interpolated; categories (distribution, shape,
+    // density map) and the brush-wide raster settings switch halfway
+    static TextureGenerator::Parameters interpolate(const TextureGenerator::Parameters& a,
+                                                    const TextureGenerator::Parameters& b, double t) {
+        auto mix = [t](int x, int y) { return (int)std::lround(x + (y - x) * t); };
+        const TextureGenerator::Parameters& nearest = t < 0.5 ? a : b;
+
+        TextureGenerator::Parameters p = nearest;
+        p.canvasSize = mix(a.canvasSize, b.canvasSize);
+        p.count = mix(a.count, b.count);
+        p.sizeMean = mix(a.sizeMean, b.sizeMean);
+        p.sizeJitter = mix(a.sizeJitter, b.sizeJitter);
+        p.opacityMean = mix(a.opacityMean, b.opacityMean);
+        p.opacityJitter = mix(a.opacityJitter, b.opacityJitter);
+        p.roundness = mix(a.roundness, b.roundness);
+        p.angle = mix(a.angle, b.angle);
+        p.falloff = mix(a.falloff, b.falloff);
+        p.distributionSquareness = mix(a.distributionSquareness, b.distributionSquareness);
+        p.distJitter = mix(a.distJitter, b.distJitter);
+        p.polygonSides = mix(a.polygonSides, b.polygonSides);
+        p.shapeEdgeFreq = mix(a.shapeEdgeFreq, b.shapeEdgeFreq);
+        p.shapeEdgeAmp = mix(a.shapeEdgeAmp, b.shapeEdgeAmp);
+        p.shapeWarpFreq = mix(a.shapeWarpFreq, b.shapeWarpFreq);
+        p.shapeWarpAmp = mix(a.shapeWarpAmp, b.shapeWarpAmp);
+        p.waveThreshold = mix(a.waveThreshold, b.waveThreshold);
+        p.particleAngle = mix(a.particleAngle, b.particleAngle);
+        p.particleAngleJitter = mix(a.particleAngleJitter, b.particleAngleJitter);
+        p.particleRoundness = mix(a.particleRoundness, b.particleRoundness);
+        p.outlineTolerance = a.outlineTolerance + (b.outlineTolerance - a.outlineTolerance) * t;
+        return p;
+    }
+
+    // Layer settings at t; blend mode and visibility switch halfway
+    static BrushLayers::Layer interpolate(const BrushLayers::Layer& a, const BrushLayers::Layer& b, double t) {
+        BrushLayers::Layer layer = t < 0.5 ? a : b;
+        layer.params = interpolate(a.params, b.params, t);
+        layer.opacity = (int)std::lround(a.opacity + (b.opacity - a.opacity) * t);
+        return layer;
+    }
+
+    // A layer present on one side only, as the invisible end of its fade
+    static BrushLayers::Layer faded(BrushLayers::Layer layer) {
+        layer.opacity = 0;
+        return layer;
+    }
+
+    // Blends two placements of the same seed, scaled to another canvas.
+    // Particles are matched by emission index; one placed on a single side
+    // (a different count, or masked by grid squareness) fades with t.
+    static std::vector<TextureGenerator::Particle> interpolate(const std::vector<TextureGenerator::Particle>& a,
+                                                               const std::vector<TextureGenerator::Particle>& b,
+                                                               double t, double scale = 1.0) {
+        std::vector<TextureGenerator::Particle> result;
+        result.reserve(std::max(a.size(), b.size()));
+        auto push = [&](TextureGenerator::Particle p, double alphaScale) {
+            p.x *= (float)scale;
+            p.y *= (float)scale;
+            p.size = std::max(1, (int)std::lround(p.size * scale));
+            p.alpha = (int)std::lround(p.alpha * alphaScale);
+            if (p.alpha > 0) result.push_back(p);
+        };
+
+        size_t i = 0, j = 0;
+        while (i < a.size() || j < b.size()) {
+            if (j == b.size() || (i < a.size() && a[i].index < b[j].index)) {
+                push(a[i++], 1.0 - t);
+            } else if (i == a.size() || b[j].index < a[i].index) {
+                push(b[j++], t);
+            } else {
+                const TextureGenerator::Particle& p = a[i++];
+                const TextureGenerator::Particle& q = b[j++];
+                push({(float)(p.x + (q.x - p.x) * t), (float)(p.y + (q.y - p.y) * t),
+                      (float)(p.angle + (q.angle - p.angle) * t), (int)std::lround(p.size + (q.size - p.size) * t),
+                      (int)std::lround(p.alpha + (q.alpha - p.alpha) * t), p.index}, 1.0);
+            }
+        }
+        return result;
+    }
+
+    // ARGB32 frame at t in [0, 1]. A draft frame renders on at most a
+    // kDraftSize canvas with analytic anti-aliasing, for scrubbing.
+    QImage render(double t, bool draft = false) const {
+        if (m_tracks.empty()) return QImage();
+        t = std::clamp(t, 0.0, 1.0);
+
+        const int fullSize = m_tracks.front().from.params.canvasSize;
+        const int size = draft ? std::min(fullSize, kDraftSize) : fullSize;
+        QImage result(size, size, QImage::Format_Alpha8);
+        result.fill(0);
+        for (const Track& track : m_tracks) {
+            BrushLayers::Layer layer = interpolate(track.from, track.to, t);
+            if (!layer.visible) continue;
+
+            TextureGenerator::Parameters& params = layer.params;
+            std::vector<TextureGenerator::Particle> particles =
+                interpolate(track.fromParticles, track.toParticles, t, (double)size / fullSize);
+            params.sizeMean = std::max(1, (int)std::lround(params.sizeMean * size / (double)fullSize));
+            params.canvasSize = size;
+            if (draft) {
+                params.supersampling = 0;
+                params.highPrecision = false;
+            }
+
+            BrushLayers::blend(result, TextureGenerator::renderCoverage(params, particles), layer);
+        }
+        return result.convertToFormat(QImage::Format_ARGB32);
+    }
+
+private:
+    struct Track {
+        BrushLayers::Layer from;
+        BrushLayers::Layer to;
+        std::vector<TextureGenerator::Particle> fromParticles;
+        std::vector<TextureGenerator::Particle> toParticles;
+    };
+
+    std::vector<Track> m_tracks;
+};
@@ -0,0 +1,376 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BRUSH_SYNTH_SSE2 1
+#endif
+
+// Low-level coverage kernels shared by the generator and the preview widgets.
+// Coverage buffers are single channel (black ink), so compositing only has to
+// track alpha: d' = s + d * (1 - s).
+//
+// High precision renders keep 16-bit transmittance instead (white paper, black
+// ink, i.e. what QPainter produces on a Grayscale16 image). Source-over of ink
+// is then a plain product, T' = T * (1 - s), and coverage is 1 - T.
+class RasterKernels {
+public:
+    // Exact rounding division by 255 for x in [0, 65535]
+    static inline int div255(int x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    static inline uint8_t over(uint8_t dst, uint8_t src) {
+        return static_cast<uint8_t>(src + div255(dst * (255 - src)));
+    }
+
+    // Exact rounding division by 65535 for x in [0, 65535^2]
+    static inline uint32_t div65535(uint32_t x) {
+        x += 32768;
+        return (x + (x >> 16)) >> 16;
+    }
+
+    // Ink coverage src (16-bit) absorbed by 16-bit transmittance
+    static inline uint16_t absorb(uint16_t transmittance, uint16_t src) {
+        return static_cast<uint16_t>(div65535((uint32_t)transmittance * (65535u - src)));
+    }
+
+    // Composites coverage in the buffer's own scale: 8-bit coverage or 16-bit transmittance
+    static inline uint8_t deposit(uint8_t dst, uint8_t src) { return over(dst, src); }
+    static inline uint16_t deposit(uint16_t dst, uint16_t src) { return absorb(dst, src); }
+
+    template <typename Pixel>
+    static constexpr int kPixelMax = sizeof(Pixel) == 1 ? 255 : 65535;
+
+    // Source-over of a span of 8-bit coverage onto 8-bit coverage
+    static void overSpan(uint8_t* dst, const uint8_t* src, int count) {
+        int i = 0;
+#ifdef BRUSH_SYNTH_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i c255 = _mm_set1_epi16(255);
+        const __m128i c128 = _mm_set1_epi16(128);
+        for (; i + 16 <= count; i += 16) {
+            __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+            // Most of a stamp is empty, skip those blocks entirely
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(s, zero)) == 0xFFFF) continue;
+            __m128i d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i));
+
+            __m128i sLo = _mm_unpacklo_epi8(s, zero);
+            __m128i sHi = _mm_unpackhi_epi8(s, zero);
+            __m128i dLo = _mm_unpacklo_epi8(d, zero);
+            __m128i dHi = _mm_unpackhi_epi8(d, zero);
+
+            __m128i tLo = _mm_add_epi16(_mm_mullo_epi16(dLo, _mm_sub_epi16(c255, sLo)), c128);
+            __m128i tHi = _mm_add_epi16(_mm_mullo_epi16(dHi, _mm_sub_epi16(c255, sHi)), c128);
+            tLo = _mm_srli_epi16(_mm_add_epi16(tLo, _mm_srli_epi16(tLo, 8)), 8);
+            tHi = _mm_srli_epi16(_mm_add_epi16(tHi, _mm_srli_epi16(tHi, 8)), 8);
+
+            __m128i r = _mm_packus_epi16(_mm_add_epi16(sLo, tLo), _mm_add_epi16(sHi, tHi));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), r);
+        }
+#endif
+        for (; i < count; ++i) {
+            if (src[i]) dst[i] = over(dst[i], src[i]);
+        }
+    }
+
+    // Box-filters factor x factor blocks of supersampled coverage into one
+    // output row. factor is a power of two up to 8 (sums stay below 2^15);
+    // scratch holds dstWidth * factor values.
+    static void downsampleBox(const uint8_t* src, std::ptrdiff_t srcStride, uint8_t* dst, int dstWidth,
+                              int factor, uint16_t* scratch) {
+        const int srcWidth = dstWidth * factor;
+
+        // Vertical: sum the factor source rows per column
+        int i = 0;
+#ifdef BRUSH_SYNTH_SSE2
+        const __m128i zero = _mm_setzero_si128();
+        for (; i + 16 <= srcWidth; i += 16) {
+            __m128i lo = zero;
+            __m128i hi = zero;
+            for (int r = 0; r < factor; ++r) {
+                __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + r * srcStride + i));
+                lo = _mm_add_epi16(lo, _mm_unpacklo_epi8(s, zero));
+                hi = _mm_add_epi16(hi, _mm_unpackhi_epi8(s, zero));
+            }
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(scratch + i), lo);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(scratch + i + 8), hi);
+        }
+#endif
+        for (; i < srcWidth; ++i) {
+            int sum = 0;
+            for (int r = 0; r < factor; ++r) sum += src[r * srcStride + i];
+            scratch[i] = (uint16_t)sum;
+        }
+
+        // Horizontal: halve the row in place once per factor of two
+        int shift = 0;
+        for (int width = srcWidth; width > dstWidth; width /= 2, shift += 2) {
+            const int half = width / 2;
+            int j = 0;
+#ifdef BRUSH_SYNTH_SSE2
+            const __m128i ones = _mm_set1_epi16(1);
+            for (; j + 8 <= half; j += 8) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scratch + 2 * j));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scratch + 2 * j + 8));
+                __m128i pairs = _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(scratch + j), pairs);
+            }
+#endif
+            for (; j < half; ++j) scratch[j] = (uint16_t)(scratch[2 * j] + scratch[2 * j + 1]);
+        }
+
+        // Rounded average
+        const int round = (1 << shift) >> 1;
+        int x = 0;
+#ifdef BRUSH_SYNTH_SSE2
+        const __m128i vRound = _mm_set1_epi16((short)round);
+        const __m128i vShift = _mm_cvtsi32_si128(shift);
+        for (; x + 16 <= dstWidth; x += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scratch + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(scratch + x + 8));
+            a = _mm_srl_epi16(_mm_add_epi16(a, vRound), vShift);
+            b = _mm_srl_epi16(_mm_add_epi16(b, vRound), vShift);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(a, b));
+        }
+#endif
+        for (; x < dstWidth; ++x) dst[x] = (uint8_t)((scratch[x] + round) >> shift);
+    }
+
+    // 16-bit transmittance variant of downsampleBox. Sums need 32 bits here,
+    // so the loops are kept plain for the compiler to vectorize.
+    static void downsampleBox16(const uint16_t* src, std::ptrdiff_t srcStride, uint16_t* dst, int dstWidth,
+                                int factor, uint32_t* scratch) {
+        const int srcWidth = dstWidth * factor;
+        const std::ptrdiff_t rowStep = srcStride / (std::ptrdiff_t)sizeof(uint16_t);
+
+        for (int i = 0; i < srcWidth; ++i) scratch[i] = src[i];
+        for (int r = 1; r < factor; ++r) {
+            const uint16_t* row = src + r * rowStep;
+            for (int i = 0; i < srcWidth; ++i) scratch[i] += row[i];
+        }
+
+        int shift = 0;
+        while ((1 << shift) < factor * factor) ++shift;
+        const uint32_t round = (1u << shift) >> 1;
+        for (int x = 0; x < dstWidth; ++x) {
+            uint32_t sum = 0;
+            for (int k = 0; k < factor; ++k) sum += scratch[x * factor + k];
+            dst[x] = (uint16_t)((sum + round) >> shift);
+        }
+    }
+
+    // 16-bit transmittance row -> 8-bit coverage with a 4x4 ordered dither.
+    // Thresholds average to half a step, so the mean is preserved and smooth
+    // low-opacity gradients do not band. y is the absolute row, so the
+    // pattern is continuous across bands.
+    static void quantizeDither(const uint16_t* src, uint8_t* dst, int count, int y) {
+        // (2 * bayer + 1) / 32 of one 8-bit step (257 in 16-bit)
+        static constexpr uint16_t kThreshold[4][4] = {
+            {8, 136, 40, 168}, {200, 72, 232, 104}, {56, 184, 24, 152}, {248, 120, 216, 88}};
+        const uint16_t* t = kThreshold[y & 3];
+
+        int x = 0;
+#ifdef BRUSH_SYNTH_SSE2
+        const __m128i ones = _mm_set1_epi16((short)0xFFFF);
+        const __m128i threshold = _mm_setr_epi16((short)t[0], (short)t[1], (short)t[2], (short)t[3],
+                                                 (short)t[0], (short)t[1], (short)t[2], (short)t[3]);
+        const __m128i inv257 = _mm_set1_epi16((short)0xFF01); // 2^24 / 257
+        for (; x + 16 <= count; x += 16) {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + x + 8));
+            // coverage = 1 - T, plus threshold (saturating: anything past 65535 is 255 anyway)
+            a = _mm_adds_epu16(_mm_xor_si128(a, ones), threshold);
+            b = _mm_adds_epu16(_mm_xor_si128(b, ones), threshold);
+            // floor(v / 257)
+            a = _mm_srli_epi16(_mm_mulhi_epu16(a, inv257), 8);
+            b = _mm_srli_epi16(_mm_mulhi_epu16(b, inv257), 8);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + x), _mm_packus_epi16(a, b));
+        }
+#endif
+        for (; x < count; ++x) {
+            int v = std::min(65535, (65535 - src[x]) + t[x & 3]);
+            dst[x] = (uint8_t)(v / 257);
+        }
+    }
+
+    static constexpr int kSplatBatch = 256;
+
+    // Sub-pixel particles queued for splatting. Positions are in pixels,
+    // area is the particle footprint in pixels and opacity is in [0, 1].
+    struct SplatBatch {
+        float x[kSplatBatch];
+        float y[kSplatBatch];
+        float area[kSplatBatch];
+        float opacity[kSplatBatch];
+        int count = 0;
+    };
+
+    // Accumulate each particle as bilinear-weighted coverage on its four
+    // nearest pixels. Weights are computed in a branch-free SoA pass that the
+    // compiler vectorizes; only the final scatter touches the buffer.
+    // Pixel is uint8_t (coverage) or uint16_t (transmittance); stride is in bytes.
+    template <typename Pixel>
+    static void splat(uint8_t* bits, int stride, int width, int height, const SplatBatch& batch) {
+        int ix[kSplatBatch];
+        int iy[kSplatBatch];
+        float c00[kSplatBatch];
+        float c10[kSplatBatch];
+        float c01[kSplatBatch];
+        float c11[kSplatBatch];
+
+        const int n = batch.count;
+        for (int k = 0; k < n; ++k) {
+            float gx = batch.x[k] - 0.5f;
+            float gy = batch.y[k] - 0.5f;
+            float flx = std::floor(gx);
+            float fly = std::floor(gy);
+            float fx = gx - flx;
+            float fy = gy - fly;
+            ix[k] = (int)flx;
+            iy[k] = (int)fly;
+
+            // Coverage of a pixel cannot exceed the particle's own opacity
+            float a = batch.area[k];
+            float o = batch.opacity[k] * (float)kPixelMax<Pixel>;
+            c00[k] = std::min(1.0f, a * (1.0f - fx) * (1.0f - fy)) * o + 0.5f;
+            c10[k] = std::min(1.0f, a * fx * (1.0f - fy)) * o + 0.5f;
+            c01[k] = std::min(1.0f, a * (1.0f - fx) * fy) * o + 0.5f;
+            c11[k] = std::min(1.0f, a * fx * fy) * o + 0.5f;
+        }
+
+        auto put = [&](int x, int y, float c) {
+            if ((unsigned)x >= (unsigned)width || (unsigned)y >= (unsigned)height) return;
+            Pixel src = (Pixel)c;
+            if (!src) return;
+            Pixel* px = reinterpret_cast<Pixel*>(bits + (std::ptrdiff_t)y * stride) + x;
+            *px = deposit(*px, src);
+        };
+
+        for (int k = 0; k < n; ++k) {
+            put(ix[k], iy[k], c00[k]);
+            put(ix[k] + 1, iy[k], c10[k]);
+            put(ix[k], iy[k] + 1, c01[k]);
+            put(ix[k] + 1, iy[k] + 1, c11[k]);
+        }
+    }
+
+    // Layer blend modes. They act on ink coverage, not colour: Over is
+    // s + d(1 - s), Add clamps s + d, Max keeps the denser layer, Multiply
+    // keeps ink only where both layers have it and Erase lets s remove ink.
+    enum BlendMode { BlendOver = 0, BlendAdd = 1, BlendMax = 2, BlendMultiply = 3, BlendErase = 4 };
+
+    // Composites a span of layer coverage onto brush coverage. Opacity (0-255)
+    // fades from the unblended brush to the full blend, as layer opacity does
+    // in an editor; for Over that is the same as scaling the layer's coverage.
+    template <typename Pixel>
+    static void blendSpan(int mode, Pixel* dst, const Pixel* src, int count, int opacity) {
+        constexpr int kMax = kPixelMax<Pixel>;
+        auto scale = [](uint32_t x) { return sizeof(Pixel) == 1 ? (uint32_t)div255((int)x) : div65535(x); };
+
+        for (int i = 0; i < count; ++i) {
+            const int d = dst[i];
+            const int s = src[i];
+            int blended;
+            switch (mode) {
+            case BlendAdd: blended = std::min(kMax, s + d); break;
+            case BlendMax: blended = std::max(s, d); break;
+            case BlendMultiply: blended = (int)scale((uint32_t)s * d); break;
+            case BlendErase: blended = (int)scale((uint32_t)d * (kMax - s)); break;
+            default: blended = s + (int)scale((uint32_t)d * (kMax - s)); break;
+            }
+            if (opacity < 255) {
+                int delta = (blended - d) * opacity;
+                blended = d + (delta >= 0 ? delta + 127 : delta - 127) / 255;
+            }
+            dst[i] = static_cast<Pixel>(blended);
+        }
+    }
+};
+
+// Coarse record of which 16x16 tiles of a buffer are fully inked (coverage
+// 255, or transmittance 0 for 16-bit buffers). Ink only ever accumulates, so a
+// saturated tile stays saturated and anything drawn over it is a no-op.
+// Drawing just marks tiles dirty; they are rescanned when next queried.
+class SaturationMask {
+public:
+    static constexpr int kTileShift = 4;
+    static constexpr int kTileSize = 1 << kTileShift;
+
+    // The buffer must be empty (no ink) when the mask is attached
+    void reset(const uint8_t* bits, int stride, int width, int height, int bytesPerPixel) {
+        m_bits = bits;
+        m_stride = stride;
+        m_width = width;
+        m_height = height;
+        m_bytesPerPixel = bytesPerPixel;
+        m_saturatedByte = bytesPerPixel == 1 ? 0xFF : 0x00;
+        m_tilesX = (width + kTileSize - 1) >> kTileShift;
+        m_tilesY = (height + kTileSize - 1) >> kTileShift;
+        m_state.assign((size_t)m_tilesX * m_tilesY, Open);
+    }
+
+    // True when every tile under the pixel rect [x0, x1] x [y0, y1] is saturated.
+    // The rect must already be clipped to the buffer.
+    bool covered(int x0, int y0, int x1, int y1) {
+        for (int ty = y0 >> kTileShift; ty <= (y1 >> kTileShift); ++ty) {
+            for (int tx = x0 >> kTileShift; tx <= (x1 >> kTileShift); ++tx) {
+                uint8_t& state = m_state[(size_t)ty * m_tilesX + tx];
+                if (state == Dirty) state = scan(tx, ty) ? Saturated : Open;
+                if (state != Saturated) return false;
+            }
+        }
+        return true;
+    }
+
+    // Marks the tiles under a clipped pixel rect as possibly changed
+    void touch(int x0, int y0, int x1, int y1) {
+        for (int ty = y0 >> kTileShift; ty <= (y1 >> kTileShift); ++ty) {
+            uint8_t* row = &m_state[(size_t)ty * m_tilesX];
+            for (int tx = x0 >> kTileShift; tx <= (x1 >> kTileShift); ++tx) {
+                if (row[tx] == Open) row[tx] = Dirty;
+            }
+        }
+    }
+
+private:
+    enum State : uint8_t { Open, Dirty, Saturated };
+
+    bool scan(int tx, int ty) const {
+        const int px0 = tx << kTileShift;
+        const int py0 = ty << kTileShift;
+        const int bytes = (std::min(m_width, px0 + kTileSize) - px0) * m_bytesPerPixel;
+        const int rows = std::min(m_height, py0 + kTileSize) - py0;
+        for (int r = 0; r < rows; ++r) {
+            const uint8_t* p = m_bits + (std::ptrdiff_t)(py0 + r) * m_stride + px0 * m_bytesPerPixel;
+            int i = 0;
+#ifdef BRUSH_SYNTH_SSE2
+            const __m128i target = _mm_set1_epi8((char)m_saturatedByte);
+            for (; i + 16 <= bytes; i += 16) {
+                __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+                if (_mm_movemask_epi8(_mm_cmpeq_epi8(v, target)) != 0xFFFF) return false;
+            }
+#endif
+            for (; i < bytes; ++i) {
+                if (p[i] != m_saturatedByte) return false;
+            }
+        }
+        return true;
+    }
+
+    const uint8_t* m_bits = nullptr;
+    int m_stride = 0;
+    int m_width = 0;
+    int m_height = 0;
+    int m_bytesPerPixel = 1;
+    uint8_t m_saturatedByte = 0xFF;
+    int m_tilesX = 0;
+    int m_tilesY = 0;
+    std::vector<uint8_t> m_state;
+};
@@ -0,0 +1,109 @@
+#ifndef RENDERSERVER_H
+#define RENDERSERVER_H
+
+#include <QObject>
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QThreadPool>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QJsonObject>
+#include <QSharedMemory>
+#include <QPointer>
+#include <QMap>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "BrushSettings.h"
+
+// Headless render daemon for pipelines (brush-synth --serve). Clients connect
+// to a QLocalServer (a Unix domain socket or named pipe) and send requests,
+// one JSON object per line:
+//
+//   {"id": 1, "format": "png", "name": "Grain", "settings": {...}}
+//
+// "settings" uses the preset schema (serializeSettings); when it is missing
+// the request itself is read as the preset. "format" is "png" (default),
+// "abr", or "shm". Every reply is one JSON header line followed by exactly
+// "bytes" bytes of payload:
+//
+//   {"id": 1, "ok": true, "format": "png", "bytes": 1234, "width": 500,
+//    "height": 500, "queueMs": 0.4, "renderMs": 12.5}
+//
+// "shm" replies carry no payload; the Alpha8 coverage rows (stride = width)
+// are left in a shared memory segment named by "key", which stays alive
+// until {"command": "release", "key": ...} or the client disconnects.
+// {"command": "stats"} replies with throughput, queue latency and tracked
+// memory per stage (MemoryTracker), current and peak since the last report.
+//
+// Requests are rendered in parallel on a worker pool and replies may arrive
+// out of order; clients match them by "id".
+class RenderServer : public QObject {
+    Q_OBJECT
+public:
+    explicit RenderServer(QObject* parent = nullptr);
+    ~RenderServer() override;
+
+    // threads <= 0 uses one worker per core
+    bool listen(const QString& name, int threads = 0);
+    QString errorString() const;
+
+private slots:
+    void acceptConnections();
+    void reportStats();
+
+private:
+    struct Job {
+        QPointer<QLocalSocket> socket;
+        QJsonValue id;
+        QJsonObject settings;
+        QString format;
+        QString name;
+        quint64 serial = 0;
+        qint64 queuedNs = 0;
+    };
+
+    struct Reply {
+        QJsonObject header;
+        QByteArray payload;
+        std::shared_ptr<QSharedMemory> segment;
+        qint64 queueNs = 0;
+        qint64 renderNs = 0;
+    };
+
+    void readRequests(QLocalSocket* socket);
+    void runCommand(QLocalSocket* socket, const QJsonObject& request);
+    Reply render(const Job& job, qint64 startedNs);
+    void deliver(const Job& job, Reply reply);
+    void write(QLocalSocket* socket, const QJsonObject& header, const QByteArray& payload = QByteArray());
+    QJsonObject stats() const;
+    std::shared_ptr<const DensityMap> densityMap(const QString& path);
+    std::shared_ptr<const StampMipChain> stampImage(const QString& source);
+    void evictCaches();
+
+    QLocalServer m_server;
+    QThreadPool m_pool;
+    QElapsedTimer m_clock;
+    QTimer m_statsTimer;
+
+    // Shared memory replies not yet released, per client
+    QMap<QLocalSocket*, QMap<QString, std::shared_ptr<QSharedMemory>>> m_segments;
+    quint64 m_requestCounter = 0;
+
+    // Density maps and stamp mip chains are built once per path and shared
+    // by all workers; both caches are emptied when memory is over the ceiling
+    std::mutex m_mapMutex;
+    QMap<QString, std::shared_ptr<const DensityMap>> m_densityMaps;
+    QMap<QString, std::shared_ptr<const StampMipChain>> m_stampImages;
+
+    // Throughput and latency: totals, plus samples since the last report
+    int m_pending = 0;
+    qint64 m_served = 0;
+    qint64 m_failed = 0;
+    qint64 m_intervalStartNs = 0;
+    std::vector<double> m_queueMs;
+    std::vector<double> m_renderMs;
+    QJsonObject m_lastInterval;
+};
+
+#endif // RENDERSERVER_H
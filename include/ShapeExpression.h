@@ -0,0 +1,485 @@
+#pragma once
+
+#include <QString>
+#include <QStringList>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "RasterKernels.h"
+
+// Small expression language for user-defined shapes, e.g. an outline radius
+// r(t, i) or a wavetable height z(u, v):
+//
+//   1 + 0.3 * sin(5 * t + i) * (abs(cos(t)) > 0.5)
+//
+// Numbers, the caller's variables, pi and e; + - * / % ^ (power), comparisons
+// (< > <= >=, giving 0 or 1) and the functions listed in functions(). Source
+// is compiled once into register bytecode with constants folded. evaluate()
+// runs each instruction over a batch of samples at a time, with SSE2 lanes
+// for the arithmetic, so interpretation costs one dispatch per instruction
+// per batch instead of per sample.
+class ShapeExpression {
+public:
+    static constexpr int kBatch = 64;
+
+    // Null with a message in error when the source does not compile.
+    // Variables are bound by position in evaluate().
+    static std::shared_ptr<const ShapeExpression> compile(const QString& source, const QStringList& variables,
+                                                          QString* error = nullptr) {
+        Parser parser(source, variables);
+        int root = parser.parse();
+        if (root < 0) {
+            if (error) *error = parser.error;
+            return nullptr;
+        }
+
+        auto expression = std::shared_ptr<ShapeExpression>(new ShapeExpression());
+        expression->m_source = source;
+        expression->m_variableCount = (int)variables.size();
+        if (!expression->generateCode(parser.nodes, root, expression->m_result)) {
+            if (error) *error = QString("Expression is too complex");
+            return nullptr;
+        }
+        if (error) error->clear();
+        return expression;
+    }
+
+    const QString& source() const { return m_source; }
+    int variableCount() const { return m_variableCount; }
+
+    // out[k] = f(inputs[0][k], inputs[1][k], ...) for k in [0, count).
+    // Safe to call from several threads at once.
+    void evaluate(const float* const* inputs, float* out, int count) const {
+        alignas(16) float temps[kMaxTemps][kBatch];
+        for (int start = 0; start < count; start += kBatch) {
+            const int n = std::min(kBatch, count - start);
+            auto operand = [&](int r) -> const float* {
+                if (r < m_variableCount) return inputs[r] + start;
+                r -= m_variableCount;
+                if (r < (int)m_constants.size()) return m_constants[r].data();
+                return temps[r - (int)m_constants.size()];
+            };
+            for (const Instruction& ins : m_code) {
+                float* d = temps[ins.dst - m_variableCount - (int)m_constants.size()];
+                run(ins.op, d, operand(ins.a), operand(ins.b), operand(ins.c), n);
+            }
+            const float* result = operand(m_result);
+            std::copy(result, result + n, out + start);
+        }
+    }
+
+    // Function names and argument counts, for documentation and tooltips
+    static QStringList functions() {
+        QStringList names;
+        for (const Function& f : functionTable()) names << QString("%1(%2)").arg(f.name).arg(f.arity);
+        return names;
+    }
+
+private:
+    static constexpr int kMaxTemps = 32;
+
+    enum Op {
+        Add, Sub, Mul, Div, Mod, Pow, Neg, Less, Greater, LessEqual, GreaterEqual,
+        Sin, Cos, Tan, Asin, Acos, Atan, Atan2, Abs, Sqrt, Exp, Log,
+        Floor, Ceil, Fract, Sign, Min, Max, Clamp, Mix, Step, Smoothstep
+    };
+
+    struct Function {
+        const char* name;
+        Op op;
+        int arity;
+    };
+
+    static const std::vector<Function>& functionTable() {
+        static const std::vector<Function> table = {
+            {"sin", Sin, 1}, {"cos", Cos, 1}, {"tan", Tan, 1}, {"asin", Asin, 1}, {"acos", Acos, 1},
+            {"atan", Atan, 1}, {"atan2", Atan2, 2}, {"abs", Abs, 1}, {"sqrt", Sqrt, 1}, {"exp", Exp, 1},
+            {"log", Log, 1}, {"floor", Floor, 1}, {"ceil", Ceil, 1}, {"fract", Fract, 1}, {"sign", Sign, 1},
+            {"min", Min, 2}, {"max", Max, 2}, {"pow", Pow, 2}, {"mod", Mod, 2}, {"clamp", Clamp, 3},
+            {"mix", Mix, 3}, {"step", Step, 2}, {"smoothstep", Smoothstep, 3},
+        };
+        return table;
+    }
+
+    // Scalar semantics of every op; constant folding uses the same code so
+    // folded and evaluated results agree
+    static inline float apply(Op op, float a, float b, float c) {
+        switch (op) {
+        case Add: return a + b;
+        case Sub: return a - b;
+        case Mul: return a * b;
+        case Div: return a / b;
+        case Mod: return a - b * std::floor(a / b);
+        case Pow: return std::pow(a, b);
+        case Neg: return -a;
+        case Less: return a < b ? 1.0f : 0.0f;
+        case Greater: return a > b ? 1.0f : 0.0f;
+        case LessEqual: return a <= b ? 1.0f : 0.0f;
+        case GreaterEqual: return a >= b ? 1.0f : 0.0f;
+        case Sin: return std::sin(a);
+        case Cos: return std::cos(a);
+        case Tan: return std::tan(a);
+        case Asin: return std::asin(a);
+        case Acos: return std::acos(a);
+        case Atan: return std::atan(a);
+        case Atan2: return std::atan2(a, b);
+        case Abs: return std::abs(a);
+        case Sqrt: return std::sqrt(a);
+        case Exp: return std::exp(a);
+        case Log: return std::log(a);
+        case Floor: return std::floor(a);
+        case Ceil: return std::ceil(a);
+        case Fract: return a - std::floor(a);
+        case Sign: return (float)((a > 0.0f) - (a < 0.0f));
+        case Min: return std::min(a, b);
+        case Max: return std::max(a, b);
+        case Clamp: return std::min(std::max(a, b), c);
+        case Mix: return a + (b - a) * c;
+        case Step: return b >= a ? 1.0f : 0.0f; // GLSL order: step(edge, x)
+        case Smoothstep: {
+            float x = std::clamp((c - a) / (b - a), 0.0f, 1.0f);
+            return x * x * (3.0f - 2.0f * x);
+        }
+        }
+        return 0.0f;
+    }
+
+    // One op over n lanes; d may alias an operand, every lane reads before it writes
+    static void run(Op op, float* d, const float* a, const float* b, const float* c, int n) {
+        int k = 0;
+#ifdef BRUSH_SYNTH_SSE2
+        switch (op) {
+        case Add: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_add_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Sub: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_sub_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Mul: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_mul_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Div: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_div_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Min: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_min_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Max: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_max_ps(_mm_loadu_ps(a + k), _mm_loadu_ps(b + k))); break;
+        case Sqrt: for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_sqrt_ps(_mm_loadu_ps(a + k))); break;
+        case Neg: {
+            const __m128 sign = _mm_set1_ps(-0.0f);
+            for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_xor_ps(_mm_loadu_ps(a + k), sign));
+            break;
+        }
+        case Abs: {
+            const __m128 sign = _mm_set1_ps(-0.0f);
+            for (; k + 4 <= n; k += 4) _mm_storeu_ps(d + k, _mm_andnot_ps(sign, _mm_loadu_ps(a + k)));
+            break;
+        }
+        case Mix:
+            for (; k + 4 <= n; k += 4) {
+                __m128 va = _mm_loadu_ps(a + k);
+                _mm_storeu_ps(d + k, _mm_add_ps(va, _mm_mul_ps(_mm_sub_ps(_mm_loadu_ps(b + k), va), _mm_loadu_ps(c + k))));
+            }
+            break;
+        case Less:
+        case Greater:
+        case LessEqual:
+        case GreaterEqual: {
+            const __m128 one = _mm_set1_ps(1.0f);
+            for (; k + 4 <= n; k += 4) {
+                __m128 va = _mm_loadu_ps(a + k);
+                __m128 vb = _mm_loadu_ps(b + k);
+                __m128 mask = op == Less ? _mm_cmplt_ps(va, vb) : op == Greater ? _mm_cmpgt_ps(va, vb)
+                            : op == LessEqual ? _mm_cmple_ps(va, vb) : _mm_cmpge_ps(va, vb);
+                _mm_storeu_ps(d + k, _mm_and_ps(mask, one));
+            }
+            break;
+        }
+        default:
+            break; // Transcendentals and the rest: scalar lanes below
+        }
+#endif
+        switch (op) {
+        case Sin: for (; k < n; ++k) d[k] = std::sin(a[k]); break;
+        case Cos: for (; k < n; ++k) d[k] = std::cos(a[k]); break;
+        default: for (; k < n; ++k) d[k] = apply(op, a[k], b[k], c[k]); break;
+        }
+    }
+
+    // Expression tree, built by the parser and consumed by generateCode()
+    struct Node {
+        enum Kind { Constant, Variable, Operation } kind;
+        float value = 0.0f; // Constant
+        int index = 0;      // Variable
+        Op op = Add;        // Operation
+        int args[3] = {-1, -1, -1};
+    };
+
+    // Recursive descent, lowest precedence first:
+    //   compare := sum (('<' | '>' | '<=' | '>=') sum)?
+    //   sum     := product (('+' | '-') product)*
+    //   product := unary (('*' | '/' | '%') unary)*
+    //   unary   := ('-' | '+') unary | power
+    //   power   := primary ('^' unary)?
+    //   primary := number | name | name '(' compare (',' compare)* ')' | '(' compare ')'
+    struct Parser {
+        Parser(const QString& source, const QStringList& variables) : text(source), names(variables) {}
+
+        int parse() {
+            int root = compare();
+            skipSpace();
+            if (root >= 0 && pos < text.size()) return fail(QString("Unexpected '%1' at %2").arg(text[pos]).arg(pos + 1));
+            return root;
+        }
+
+        int compare() {
+            int left = sum();
+            skipSpace();
+            if (left < 0 || pos >= text.size() || (text[pos] != '<' && text[pos] != '>')) return left;
+            bool less = text[pos++] == '<';
+            bool equal = pos < text.size() && text[pos] == '=';
+            if (equal) ++pos;
+            Op op = less ? (equal ? LessEqual : Less) : (equal ? GreaterEqual : Greater);
+            return operation(op, left, sum());
+        }
+
+        int sum() {
+            int left = product();
+            for (;;) {
+                skipSpace();
+                if (left < 0 || pos >= text.size() || (text[pos] != '+' && text[pos] != '-')) return left;
+                Op op = text[pos++] == '+' ? Add : Sub;
+                left = operation(op, left, product());
+            }
+        }
+
+        int product() {
+            int left = unary();
+            for (;;) {
+                skipSpace();
+                if (left < 0 || pos >= text.size() || (text[pos] != '*' && text[pos] != '/' && text[pos] != '%')) return left;
+                QChar c = text[pos++];
+                left = operation(c == '*' ? Mul : c == '/' ? Div : Mod, left, unary());
+            }
+        }
+
+        int unary() {
+            skipSpace();
+            if (pos < text.size() && (text[pos] == '-' || text[pos] == '+')) {
+                bool negate = text[pos++] == '-';
+                int operand = unary();
+                return negate ? operation(Neg, operand) : operand;
+            }
+            return power();
+        }
+
+        int power() {
+            int base = primary();
+            skipSpace();
+            if (base < 0 || pos >= text.size() || text[pos] != '^') return base;
+            ++pos;
+            return operation(Pow, base, unary()); // Right associative, 2^-x allowed
+        }
+
+        int primary() {
+            skipSpace();
+            if (pos >= text.size()) return fail("Unexpected end of expression");
+            QChar c = text[pos];
+
+            if (c == '(') {
+                ++pos;
+                int inner = compare();
+                return inner < 0 || expect(')') ? inner : -1;
+            }
+
+            if (c.isDigit() || c == '.') {
+                int start = pos;
+                while (pos < text.size() && (text[pos].isDigit() || text[pos] == '.')) ++pos;
+                // Exponent, as in 1e-3
+                if (pos < text.size() && (text[pos] == 'e' || text[pos] == 'E')) {
+                    int mark = pos++;
+                    if (pos < text.size() && (text[pos] == '+' || text[pos] == '-')) ++pos;
+                    if (pos < text.size() && text[pos].isDigit()) {
+                        while (pos < text.size() && text[pos].isDigit()) ++pos;
+                    } else {
+                        pos = mark;
+                    }
+                }
+                bool ok = false;
+                float value = text.mid(start, pos - start).toFloat(&ok);
+                if (!ok) return fail(QString("Bad number at %1").arg(start + 1));
+                return constant(value);
+            }
+
+            if (c.isLetter() || c == '_') {
+                int start = pos;
+                while (pos < text.size() && (text[pos].isLetterOrNumber() || text[pos] == '_')) ++pos;
+                QString name = text.mid(start, pos - start);
+                skipSpace();
+                if (pos < text.size() && text[pos] == '(') {
+                    ++pos;
+                    return call(name);
+                }
+                int index = names.indexOf(name);
+                if (index >= 0) {
+                    Node node{Node::Variable};
+                    node.index = index;
+                    return add(node);
+                }
+                if (name == "pi") return constant((float)M_PI);
+                if (name == "e") return constant((float)M_E);
+                return fail(QString("Unknown variable '%1'").arg(name));
+            }
+            return fail(QString("Unexpected '%1' at %2").arg(c).arg(pos + 1));
+        }
+
+        int call(const QString& name) {
+            const Function* function = nullptr;
+            for (const Function& f : functionTable()) {
+                if (name == QLatin1String(f.name)) function = &f;
+            }
+            if (!function) return fail(QString("Unknown function '%1'").arg(name));
+
+            int args[3] = {-1, -1, -1};
+            for (int k = 0; k < function->arity; ++k) {
+                if (k > 0) {
+                    skipSpace();
+                    if (pos >= text.size() || text[pos] != ',') return fail(QString("%1() takes %2 arguments").arg(name).arg(function->arity));
+                    ++pos;
+                }
+                args[k] = compare();
+                if (args[k] < 0) return -1;
+            }
+            if (!expect(')')) return -1;
+            return operation(function->op, args[0], args[1], args[2]);
+        }
+
+        // Folds the operation when every argument is a constant
+        int operation(Op op, int a, int b = -1, int c = -1) {
+            if (a < 0 || (b < 0 && arity(op) > 1) || (c < 0 && arity(op) > 2)) return -1;
+            Node node{Node::Operation};
+            node.op = op;
+            node.args[0] = a;
+            node.args[1] = b;
+            node.args[2] = c;
+            bool folded = true;
+            float values[3] = {0.0f, 0.0f, 0.0f};
+            for (int k = 0; k < arity(op); ++k) {
+                folded = folded && nodes[node.args[k]].kind == Node::Constant;
+                if (folded) values[k] = nodes[node.args[k]].value;
+            }
+            if (folded) return constant(apply(op, values[0], values[1], values[2]));
+            return add(node);
+        }
+
+        int constant(float value) {
+            Node node{Node::Constant};
+            node.value = value;
+            return add(node);
+        }
+
+        int add(const Node& node) {
+            nodes.push_back(node);
+            return (int)nodes.size() - 1;
+        }
+
+        bool expect(char c) {
+            skipSpace();
+            if (pos < text.size() && text[pos] == c) {
+                ++pos;
+                return true;
+            }
+            if (error.isEmpty()) {
+                error = pos < text.size() ? QString("Expected '%1' at %2").arg(c).arg(pos + 1)
+                                          : QString("Expected '%1' at the end").arg(c);
+            }
+            return false;
+        }
+
+        int fail(const QString& message) {
+            if (error.isEmpty()) error = message;
+            return -1;
+        }
+
+        void skipSpace() {
+            while (pos < text.size() && text[pos].isSpace()) ++pos;
+        }
+
+        const QString& text;
+        const QStringList& names;
+        int pos = 0;
+        QString error;
+        std::vector<Node> nodes;
+    };
+
+    struct Instruction {
+        Op op;
+        int dst;
+        int a, b, c;
+    };
+
+    static int arity(Op op) {
+        switch (op) {
+        case Neg: case Sin: case Cos: case Tan: case Asin: case Acos: case Atan: case Abs:
+        case Sqrt: case Exp: case Log: case Floor: case Ceil: case Fract: case Sign:
+            return 1;
+        case Clamp: case Mix: case Smoothstep:
+            return 3;
+        default:
+            return 2;
+        }
+    }
+
+    ShapeExpression() = default;
+
+    // Registers are numbered variables, then constants, then temporaries.
+    // Temporaries are freed as soon as their value is consumed, so the
+    // register count follows the tree's depth, not its size.
+    bool generateCode(const std::vector<Node>& nodes, int root, int& result) {
+        std::vector<bool> busy(kMaxTemps, false);
+        std::vector<int> constantRegister(nodes.size(), -1);
+
+        // Constants first, so temporaries know where they start. Folding
+        // leaves dead constants behind, only those still in the tree count.
+        std::function<void(int)> collect = [&](int index) {
+            const Node& node = nodes[index];
+            if (node.kind == Node::Operation) {
+                for (int k = 0; k < arity(node.op); ++k) collect(node.args[k]);
+            } else if (node.kind == Node::Constant && constantRegister[index] < 0) {
+                constantRegister[index] = m_variableCount + (int)m_constants.size();
+                std::array<float, kBatch> lanes;
+                lanes.fill(node.value);
+                m_constants.push_back(lanes);
+            }
+        };
+        collect(root);
+        const int firstTemp = m_variableCount + (int)m_constants.size();
+
+        bool ok = true;
+        auto isTemp = [&](int r) { return r >= firstTemp; };
+        std::function<int(int)> visit = [&](int index) -> int {
+            const Node& node = nodes[index];
+            if (node.kind == Node::Constant) return constantRegister[index];
+            if (node.kind == Node::Variable) return node.index;
+
+            int regs[3] = {0, 0, 0};
+            int count = arity(node.op);
+            for (int k = 0; k < count; ++k) regs[k] = visit(node.args[k]);
+            for (int k = 0; k < count; ++k) {
+                if (isTemp(regs[k])) busy[regs[k] - firstTemp] = false;
+            }
+            auto slot = std::find(busy.begin(), busy.end(), false);
+            if (slot == busy.end()) {
+                ok = false;
+                return firstTemp;
+            }
+            *slot = true;
+            int dst = firstTemp + (int)(slot - busy.begin());
+            for (int k = count; k < 3; ++k) regs[k] = regs[0]; // Unused operands point somewhere valid
+            m_code.push_back({node.op, dst, regs[0], regs[1], regs[2]});
+            return dst;
+        };
+        result = visit(root);
+        return ok;
+    }
+
+    QString m_source;
+    int m_variableCount = 0;
+    std::vector<std::array<float, kBatch>> m_constants;
+    std::vector<Instruction> m_code;
+    int m_result = 0;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <QImage>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#include "MemoryTracker.h"
+#include "RasterKernels.h"
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+// Alpha8 particle stamp pre-filtered into a mip chain (2x2 box filter per
+// level). Levels carry a one texel transparent border so bilinear taps never
+// need bounds checks.
+class StampMipChain {
+public:
+    struct Level {
+        int width = 0;
+        int height = 0;
+        int pitch = 0; // width + 2
+        std::vector<uint8_t> texels; // (width + 2) * (height + 2), border is zero
+
+        uint8_t at(int x, int y) const { return texels[(y + 1) * pitch + (x + 1)]; }
+        uint8_t& at(int x, int y) { return texels[(y + 1) * pitch + (x + 1)]; }
+    };
+
+    static std::shared_ptr<const StampMipChain> fromImage(const QImage& image) {
+        if (image.isNull()) return nullptr;
+        QImage alpha = image.convertToFormat(QImage::Format_Alpha8);
+
+        auto chain = std::make_shared<StampMipChain>();
+        Level base = makeLevel(alpha.width(), alpha.height());
+        qint64 sum = 0;
+        for (int y = 0; y < base.height; ++y) {
+            const uchar* line = alpha.constScanLine(y);
+            std::copy(line, line + base.width, &base.at(0, y));
+            for (int x = 0; x < base.width; ++x) sum += line[x];
+        }
+        chain->m_inkFraction = sum / (255.0 * base.width * base.height);
+        chain->m_levels.push_back(std::move(base));
+
+        while (chain->m_levels.back().width > 1 || chain->m_levels.back().height > 1) {
+            chain->m_levels.push_back(downsample(chain->m_levels.back()));
+        }
+        qint64 bytes = 0;
+        for (const Level& level : chain->m_levels) bytes += (qint64)level.texels.capacity();
+        chain->m_bytes.set(bytes);
+        return chain;
+    }
+
+    // Imported particle tip: ink is dark, opaque pixels, so black-on-white
+    // images, black-with-alpha exports and ABR tips all read the same way.
+    // The tip is centred on a square canvas, keeping its aspect ratio, and
+    // large tips are reduced to maxSide. Null when the image holds no ink.
+    static std::shared_ptr<const StampMipChain> fromTip(const QImage& source, int maxSide = 1024) {
+        if (source.isNull()) return nullptr;
+
+        QImage image = source;
+        if (image.width() > maxSide || image.height() > maxSide) {
+            image = image.scaled(maxSide, maxSide, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        image = image.convertToFormat(QImage::Format_ARGB32);
+
+        int side = std::max(image.width(), image.height());
+        int left = (side - image.width()) / 2;
+        int top = (side - image.height()) / 2;
+        QImage ink(side, side, QImage::Format_Alpha8);
+        ink.fill(0);
+        bool any = false;
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb* line = reinterpret_cast<const QRgb*>(image.constScanLine(y));
+            uchar* out = ink.scanLine(top + y) + left;
+            for (int x = 0; x < image.width(); ++x) {
+                out[x] = (uchar)((qAlpha(line[x]) * (255 - qGray(line[x])) + 127) / 255);
+                any = any || out[x];
+            }
+        }
+        return any ? fromImage(ink) : nullptr;
+    }
+
+    int levelCount() const { return (int)m_levels.size(); }
+    const Level& level(int i) const { return m_levels[i]; }
+
+    // Fraction of the stamp square that is ink
+    double inkFraction() const { return m_inkFraction; }
+
+private:
+    static Level makeLevel(int width, int height) {
+        Level level;
+        level.width = width;
+        level.height = height;
+        level.pitch = width + 2;
+        level.texels.assign((size_t)(width + 2) * (height + 2), 0);
+        return level;
+    }
+
+    static Level downsample(const Level& src) {
+        Level dst = makeLevel(std::max(1, (src.width + 1) / 2), std::max(1, (src.height + 1) / 2));
+        for (int y = 0; y < dst.height; ++y) {
+            int sy0 = std::min(2 * y, src.height - 1);
+            int sy1 = std::min(2 * y + 1, src.height - 1);
+            for (int x = 0; x < dst.width; ++x) {
+                int sx0 = std::min(2 * x, src.width - 1);
+                int sx1 = std::min(2 * x + 1, src.width - 1);
+                int sum = src.at(sx0, sy0) + src.at(sx1, sy0) + src.at(sx0, sy1) + src.at(sx1, sy1);
+                dst.at(x, y) = (uint8_t)((sum + 2) / 4);
+            }
+        }
+        return dst;
+    }
+
+    std::vector<Level> m_levels;
+    double m_inkFraction = 0.0;
+    TrackedBytes m_bytes{MemoryTracker::Stamp}; // Every level, for as long as the chain lives
+};
+
+// Affine stamp blitter: draws a mip-mapped stamp with rotation and vertical
+// scale, sampling bilinearly (trilinearly between levels) and compositing
+// source-over straight into an 8-bit coverage or 16-bit transmittance buffer.
+class StampBlitter {
+public:
+    // The stamp covers a size x size square centred at (cx, cy) before the
+    // vertical scale and the rotation (degrees, clockwise on screen), matching
+    // QPainter's translate/rotate/scale order. Pixel is uint8_t or uint16_t
+    // (see RasterKernels); stride is in bytes.
+    template <typename Pixel>
+    static void blit(uint8_t* bits, int stride, int width, int height, const StampMipChain& chain,
+                     double cx, double cy, double size, double angleDeg, double yScale, double opacity) {
+        if (size <= 0.0 || yScale <= 0.0 || opacity <= 0.0) return;
+
+        double rad = angleDeg * M_PI / 180.0;
+        double cosA = std::cos(rad);
+        double sinA = std::sin(rad);
+
+        // Bounding box of the rotated, scaled square
+        double halfW = size / 2.0;
+        double halfH = size / 2.0 * yScale;
+        double extX = std::abs(cosA) * halfW + std::abs(sinA) * halfH;
+        double extY = std::abs(sinA) * halfW + std::abs(cosA) * halfH;
+        int x0 = std::max(0, (int)std::floor(cx - extX));
+        int x1 = std::min(width - 1, (int)std::ceil(cx + extX));
+        int y0 = std::max(0, (int)std::floor(cy - extY));
+        int y1 = std::min(height - 1, (int)std::ceil(cy + extY));
+        if (x0 > x1 || y0 > y1) return;
+
+        // Level of detail from the most minified axis
+        const StampMipChain::Level& base = chain.level(0);
+        double rho = std::max(base.width / size, base.height / (size * yScale));
+        double lod = rho > 1.0 ? std::log2(rho) : 0.0;
+        int last = chain.levelCount() - 1;
+        int l0 = std::min((int)lod, last);
+        int l1 = std::min(l0 + 1, last);
+        float blend = (l0 == l1) ? 0.0f : (float)(lod - l0);
+
+        LevelMap mapA = levelMap(chain.level(l0), size, cosA, sinA, yScale);
+        LevelMap mapB = levelMap(chain.level(l1), size, cosA, sinA, yScale);
+        bool trilinear = blend > 1.0f / 256.0f;
+        // Texels are 8-bit, rescale to the buffer's range
+        constexpr int pixelMax = RasterKernels::kPixelMax<Pixel>;
+        float opacityF = (float)opacity * (pixelMax / 255.0f);
+
+        for (int y = y0; y <= y1; ++y) {
+            Pixel* row = reinterpret_cast<Pixel*>(bits + (std::ptrdiff_t)y * stride);
+            double dy = y + 0.5 - cy;
+            double dx = x0 + 0.5 - cx;
+            float tuA = (float)(mapA.u0 + dx * mapA.dudx + dy * mapA.dudy);
+            float tvA = (float)(mapA.v0 + dx * mapA.dvdx + dy * mapA.dvdy);
+            float tuB = (float)(mapB.u0 + dx * mapB.dudx + dy * mapB.dudy);
+            float tvB = (float)(mapB.v0 + dx * mapB.dvdx + dy * mapB.dvdy);
+
+            int x = x0;
+#ifdef BRUSH_SYNTH_SSE2
+            const __m128 ramp = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+            const __m128 vOpacity = _mm_set1_ps(opacityF);
+            const __m128 vHalf = _mm_set1_ps(0.5f);
+            const __m128 vBlend = _mm_set1_ps(blend);
+            for (; x + 3 <= x1; x += 4) {
+                __m128 offs = _mm_add_ps(_mm_set1_ps((float)(x - x0)), ramp);
+                __m128 value = sample4(*mapA.level,
+                                       _mm_add_ps(_mm_set1_ps(tuA), _mm_mul_ps(offs, _mm_set1_ps((float)mapA.dudx))),
+                                       _mm_add_ps(_mm_set1_ps(tvA), _mm_mul_ps(offs, _mm_set1_ps((float)mapA.dvdx))));
+                if (trilinear) {
+                    __m128 valueB = sample4(*mapB.level,
+                                            _mm_add_ps(_mm_set1_ps(tuB), _mm_mul_ps(offs, _mm_set1_ps((float)mapB.dudx))),
+                                            _mm_add_ps(_mm_set1_ps(tvB), _mm_mul_ps(offs, _mm_set1_ps((float)mapB.dvdx))));
+                    value = _mm_add_ps(value, _mm_mul_ps(_mm_sub_ps(valueB, value), vBlend));
+                }
+                __m128i src = _mm_cvttps_epi32(_mm_add_ps(_mm_mul_ps(value, vOpacity), vHalf));
+                // Skip fully transparent quads before touching the destination
+                if (_mm_movemask_epi8(_mm_cmpeq_epi32(src, _mm_setzero_si128())) == 0xFFFF) continue;
+
+                alignas(16) int s[4];
+                _mm_store_si128(reinterpret_cast<__m128i*>(s), src);
+                for (int k = 0; k < 4; ++k) {
+                    if (s[k]) row[x + k] = RasterKernels::deposit(row[x + k], (Pixel)std::min(s[k], pixelMax));
+                }
+            }
+#endif
+            for (; x <= x1; ++x) {
+                float offs = (float)(x - x0);
+                float value = sample(*mapA.level, tuA + offs * (float)mapA.dudx, tvA + offs * (float)mapA.dvdx);
+                if (trilinear) {
+                    float valueB = sample(*mapB.level, tuB + offs * (float)mapB.dudx, tvB + offs * (float)mapB.dvdx);
+                    value += (valueB - value) * blend;
+                }
+                int s = (int)(value * opacityF + 0.5f);
+                if (s) row[x] = RasterKernels::deposit(row[x], (Pixel)std::min(s, pixelMax));
+            }
+        }
+    }
+
+private:
+    // Pixel offset from the stamp centre -> texel coordinates of one level
+    struct LevelMap {
+        const StampMipChain::Level* level;
+        double u0, dudx, dudy;
+        double v0, dvdx, dvdy;
+    };
+
+    static LevelMap levelMap(const StampMipChain::Level& level, double size, double cosA, double sinA, double yScale) {
+        // Inverse of scale(1, yScale) then rotate(angle): rotate back, unscale Y
+        double su = level.width / size;
+        double sv = level.height / (size * yScale);
+        LevelMap map;
+        map.level = &level;
+        map.u0 = level.width / 2.0 - 0.5;
+        map.dudx = cosA * su;
+        map.dudy = sinA * su;
+        map.v0 = level.height / 2.0 - 0.5;
+        map.dvdx = -sinA * sv;
+        map.dvdy = cosA * sv;
+        return map;
+    }
+
+    // Bilinear tap in [0, 255]; coordinates are clamped into the zero border
+    static inline float sample(const StampMipChain::Level& level, float tu, float tv) {
+        float pu = std::clamp(tu, -1.0f, level.width - 0.001f) + 1.0f;
+        float pv = std::clamp(tv, -1.0f, level.height - 0.001f) + 1.0f;
+        int iu = (int)pu;
+        int iv = (int)pv;
+        float fx = pu - iu;
+        float fy = pv - iv;
+        const uint8_t* p = level.texels.data() + iv * level.pitch + iu;
+        float top = p[0] + (p[1] - p[0]) * fx;
+        float bottom = p[level.pitch] + (p[level.pitch + 1] - p[level.pitch]) * fx;
+        return top + (bottom - top) * fy;
+    }
+
+#ifdef BRUSH_SYNTH_SSE2
+    static inline __m128 sample4(const StampMipChain::Level& level, __m128 tu, __m128 tv) {
+        const __m128 one = _mm_set1_ps(1.0f);
+        const __m128 lo = _mm_set1_ps(-1.0f);
+        __m128 pu = _mm_add_ps(_mm_min_ps(_mm_max_ps(tu, lo), _mm_set1_ps(level.width - 0.001f)), one);
+        __m128 pv = _mm_add_ps(_mm_min_ps(_mm_max_ps(tv, lo), _mm_set1_ps(level.height - 0.001f)), one);
+        __m128i iu = _mm_cvttps_epi32(pu);
+        __m128i iv = _mm_cvttps_epi32(pv);
+        __m128 fx = _mm_sub_ps(pu, _mm_cvtepi32_ps(iu));
+        __m128 fy = _mm_sub_ps(pv, _mm_cvtepi32_ps(iv));
+
+        // SSE2 has no gather, so the four taps per lane are fetched scalar
+        alignas(16) int us[4];
+        alignas(16) int vs[4];
+        alignas(16) float t00[4];
+        alignas(16) float t10[4];
+        alignas(16) float t01[4];
+        alignas(16) float t11[4];
+        _mm_store_si128(reinterpret_cast<__m128i*>(us), iu);
+        _mm_store_si128(reinterpret_cast<__m128i*>(vs), iv);
+        for (int k = 0; k < 4; ++k) {
+            const uint8_t* p = level.texels.data() + vs[k] * level.pitch + us[k];
+            t00[k] = p[0];
+            t10[k] = p[1];
+            t01[k] = p[level.pitch];
+            t11[k] = p[level.pitch + 1];
+        }
+
+        __m128 a = _mm_load_ps(t00);
+        __m128 b = _mm_load_ps(t10);
+        __m128 c = _mm_load_ps(t01);
+        __m128 d = _mm_load_ps(t11);
+        __m128 top = _mm_add_ps(a, _mm_mul_ps(_mm_sub_ps(b, a), fx));
+        __m128 bottom = _mm_add_ps(c, _mm_mul_ps(_mm_sub_ps(d, c), fx));
+        return _mm_add_ps(top, _mm_mul_ps(_mm_sub_ps(bottom, top), fy));
+    }
+#endif
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <QWidget>
+#include <QImage>
+#include <QPainter>
+#include <QPolygonF>
+#include <QMouseEvent>
+#include <QLineF>
+#include <QList>
+#include <QString>
+#include <algorithm>
+#include "RasterKernels.h"
+
+// Stroke test pad: stamps the current brush tip along a user-drawn path at the
+// ABR spacing, so the brush can be judged in a stroke before export.
+class StrokePreviewWidget : public QWidget {
+    Q_OBJECT
+public:
+    explicit StrokePreviewWidget(QWidget* parent = nullptr) : QWidget(parent) {
+        setMinimumSize(200, 120);
+        setAttribute(Qt::WA_OpaquePaintEvent, true);
+        setCursor(Qt::CrossCursor);
+    }
+
+    void setBrushImage(const QImage& image) {
+        m_brush = image;
+        prepareTip();
+        restamp();
+    }
+
+    // Spacing in percent of the tip diameter, same meaning as AbrWriter::writeAbr
+    void setSpacing(int spacingPercent) {
+        if (spacingPercent < 1) spacingPercent = 1;
+        if (m_spacing == spacingPercent) return;
+        m_spacing = spacingPercent;
+        restamp();
+    }
+
+    int spacing() const {
+        return m_spacing;
+    }
+
+    // Shown while nothing is drawn; set by the window in its language
+    void setPlaceholderText(const QString& text) {
+        m_placeholder = text;
+        if (m_strokes.isEmpty()) update();
+    }
+
+public slots:
+    void clear() {
+        m_strokes.clear();
+        m_canvas.fill(0);
+        update();
+    }
+
+protected:
+    void paintEvent(QPaintEvent* event) override {
+        QPainter painter(this);
+        QRect r = event->rect();
+        painter.fillRect(r, Qt::white);
+
+        if (m_strokes.isEmpty()) {
+            painter.setPen(QColor(160, 160, 160));
+            painter.drawText(rect(), Qt::AlignCenter, m_placeholder);
+            return;
+        }
+
+        // Alpha8 draws as black ink with coverage as alpha
+        painter.drawImage(r, m_canvas, r);
+    }
+
+    void resizeEvent(QResizeEvent* event) override {
+        QWidget::resizeEvent(event);
+        prepareTip();
+        restamp();
+    }
+
+    void mousePressEvent(QMouseEvent* event) override {
+        if (event->button() != Qt::LeftButton) return;
+        m_strokes.append(QPolygonF() << event->position());
+        m_dirty = QRect();
+        beginStroke(event->position());
+        update(m_dirty);
+    }
+
+    void mouseMoveEvent(QMouseEvent* event) override {
+        if (!(event->buttons() & Qt::LeftButton) || m_strokes.isEmpty()) return;
+        m_strokes.last() << event->position();
+        m_dirty = QRect();
+        strokeTo(event->position());
+        update(m_dirty);
+    }
+
+private:
+    void prepareTip() {
+        if (m_brush.isNull() || width() <= 0 || height() <= 0) {
+            m_tip = QImage();
+            return;
+        }
+
+        // Large tips are shown at a size that still leaves room to draw
+        int maxTip = std::max(8, (int)(height() * 0.4));
+        QImage source = m_brush.convertToFormat(QImage::Format_ARGB32_Premultiplied);
+        if (source.width() > maxTip || source.height() > maxTip) {
+            source = source.scaled(maxTip, maxTip, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+        }
+        m_tip = source.convertToFormat(QImage::Format_Alpha8);
+    }
+
+    double stepLength() const {
+        int diameter = std::max(m_tip.width(), m_tip.height());
+        return std::max(1.0, diameter * m_spacing / 100.0);
+    }
+
+    void beginStroke(const QPointF& pos) {
+        m_lastInput = pos;
+        m_travelled = 0.0;
+        stamp(pos);
+    }
+
+    // Walk the segment from the last input point, stamping every stepLength()
+    // and carrying the remainder over to the next segment
+    void strokeTo(const QPointF& pos) {
+        double len = QLineF(m_lastInput, pos).length();
+        if (len <= 0.0) return;
+
+        double step = stepLength();
+        double t = step - m_travelled;
+        for (; t <= len; t += step) {
+            stamp(m_lastInput + (pos - m_lastInput) * (t / len));
+        }
+        m_travelled = len - (t - step);
+        m_lastInput = pos;
+    }
+
+    void stamp(const QPointF& center) {
+        if (m_tip.isNull()) return;
+
+        int x0 = qRound(center.x() - m_tip.width() / 2.0);
+        int y0 = qRound(center.y() - m_tip.height() / 2.0);
+        QRect target = QRect(x0, y0, m_tip.width(), m_tip.height()).intersected(m_canvas.rect());
+        if (target.isEmpty()) return;
+
+        for (int y = target.top(); y <= target.bottom(); ++y) {
+            const uchar* src = m_tip.constScanLine(y - y0) + (target.left() - x0);
+            uchar* dst = m_canvas.scanLine(y) + target.left();
+            RasterKernels::overSpan(dst, src, target.width());
+        }
+        m_dirty |= target;
+    }
+
+    // Replay all recorded strokes, e.g. after the tip or spacing changed
+    void restamp() {
+        if (m_canvas.size() != size()) {
+            m_canvas = QImage(size(), QImage::Format_Alpha8);
+        }
+        m_canvas.fill(0);
+
+        for (const QPolygonF& stroke : m_strokes) {
+            beginStroke(stroke.first());
+            for (int i = 1; i < stroke.size(); ++i) {
+                strokeTo(stroke[i]);
+            }
+        }
+        update();
+    }
+
+    QImage m_brush;
+    QImage m_tip;
+    QImage m_canvas;
+    QList<QPolygonF> m_strokes;
+    QPointF m_lastInput;
+    double m_travelled = 0.0;
+    QRect m_dirty;
+    int m_spacing = 25;
+    QString m_placeholder;
+};
@@ -2,9 +2,21 @@
 
 #include <QImage>
 #include <QPainter>
-#include <QPainterPath>
+#include <QTransform>
 #include <QRandomGenerator>
 #include <cmath>
+#include <vector>
+#include <array>
+#include <type_traits>
+#include <utility>
+#include <algorithm>
+#include <memory>
+#include <functional>
+#include "DensityMap.h"
+#include "RasterKernels.h"
+#include "StampBlitter.h"
+#include "MemoryTracker.h"
+#include "ShapeExpression.h"
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
@@ -22,15 +34,17 @@ public:
         int angle;     // 0-360
         int falloff;   // 0-100
         int distributionSquareness; // 0-100
-        int distType; // 0=Random, 1=Grid, 2=Spiral
+        int distType; // 0=Random, 1=Grid, 2=Spiral, 3=Blue Noise, 4=Density Map
         int distJitter; // 0-100
+        quint32 seed = 0; // 0 = new layout every render
+        std::shared_ptr<const DensityMap> densityMap; // Used by distType 4
 
         // Shape Synthesis Params
-        int shapeId; // 0=Circle, 1=Triangle, 2=Square, 3=Polygon
+        int shapeId; // 0=Circle, 1=Triangle, 2=Square, 3=Polygon, 4=Wavetable, 5=Image, 6=Expression
         int polygonSides; // 3-16
         int shapeEdgeFreq; // 0-50
         int shapeEdgeAmp; // 0-100 (Percentage of radius)
-        
+
         // Shape Distortion Params (Phase Warp)
         int shapeWarpFreq; // 1-20
         int shapeWarpAmp;  // 0-100 (Phase shift intensity)
@@ -38,118 +52,805 @@ public:
         // Wavetable Params
         int waveThreshold; // 0-100 (Cutoff level)
 
+        // Image Params: imported tip, pre-filtered once when it is loaded
+        std::shared_ptr<const StampMipChain> stampImage; // Used by shapeId 5
+
+        // Expression Params: user formulas, compiled once when they are edited
+        std::shared_ptr<const ShapeExpression> radiusExpression; // r(t, i), used by shapeId 6
+        std::shared_ptr<const ShapeExpression> waveExpression;   // z(u, v), replaces the built-in wavetable when set
+
         // Particle Transform Params
         int particleAngle; // 0-360
         int particleAngleJitter; // 0-100%
         int particleRoundness; // 1-100%
+
+        // Anti-aliasing: 0=Analytic (QPainter antialiasing), 1=Off,
+        // 2/4/8=NxN supersampling with a box downsample
+        int supersampling = 0;
+        // Accumulate in 16 bits and dither down, for many low-opacity particles
+        bool highPrecision = false;
+        // Largest distance (px) an outline may stray from the exact shape
+        double outlineTolerance = 0.15;
     };
 
+    // Switches the bench flips to measure what each optimization buys; a
+    // null BenchOptions* renders with the defaults
+    struct BenchOptions {
+        // false runs the generic (runtime-branching) kernels
+        bool specializeKernels = true;
+        // false draws particles even over fully inked areas
+        bool skipSaturated = true;
+        // false rasterizes in emission order instead of tile (Z-order) order
+        bool spatialSort = true;
+        // true samples outlines at the fixed 30 + min(size, 100) steps used
+        // before the error bound, as the tessellation reference
+        bool legacyOutlineSteps = false;
+    };
+
+    // Optional counters filled in by render()
+    struct RenderStats {
+        qint64 particles = 0; // Particle draws considered; band renders count each band a particle touches
+        qint64 skipped = 0;   // Dropped because every tile under them was already saturated
+        qint64 vertices = 0;  // Outline vertices generated
+    };
+
+    // Output of the placement stage, input of the raster stage
+    struct Particle {
+        float x;     // Canvas position (px)
+        float y;
+        float angle; // Particle rotation (deg)
+        int size;    // Diameter (px)
+        int alpha;   // 0-255
+        int index;   // Emission index, drives the per-particle edge phase
+    };
+
+    // Particles at or below this size (px) skip QPainter and are splatted
+    static constexpr int kSplatMaxSize = 2;
+
     static QImage generate(const Parameters& params) {
-        QImage image(params.canvasSize, params.canvasSize, QImage::Format_ARGB32);
-        image.fill(Qt::transparent);
+        return render(params, place(params));
+    }
+
+    // Placement stage: position, size, opacity and rotation of every particle.
+    // The kernel is specialized on distribution, falloff and squareness and
+    // picked once per render.
+    static std::vector<Particle> place(const Parameters& params, const BenchOptions* options = nullptr) {
+        static const auto kernels = makeKernelTable<PlacementFn, kPlacementVariants>(
+            [](auto flags) { return &placeParticles<decltype(flags)::value>; });
+
+        std::vector<Particle> particles;
+        const bool specialized = !options || options->specializeKernels;
+        PlacementFn kernel = specialized ? kernels[placementFlags(params)] : &placeParticles<kGenericKernel>;
+        kernel(params, particles);
+        return particles;
+    }
+
+    // True when both parameter sets place the same particles, i.e. they only
+    // differ in raster-stage (shape and anti-aliasing) fields
+    static bool samePlacement(const Parameters& a, const Parameters& b) {
+        return a.canvasSize == b.canvasSize && a.count == b.count && a.sizeMean == b.sizeMean
+            && a.sizeJitter == b.sizeJitter && a.opacityMean == b.opacityMean && a.opacityJitter == b.opacityJitter
+            && a.roundness == b.roundness && a.angle == b.angle && a.falloff == b.falloff
+            && a.distributionSquareness == b.distributionSquareness && a.distType == b.distType
+            && a.distJitter == b.distJitter && a.seed == b.seed && a.seed != 0 && a.densityMap == b.densityMap
+            && a.shapeEdgeAmp == b.shapeEdgeAmp && a.particleAngle == b.particleAngle
+            && a.particleAngleJitter == b.particleAngleJitter;
+    }
+
+    // Raster stage: draws placed particles into a coverage buffer
+    static QImage render(const Parameters& params, const std::vector<Particle>& particles, RenderStats* stats = nullptr,
+                         const BenchOptions* options = nullptr) {
+        return renderCoverage(params, particles, stats, options).convertToFormat(QImage::Format_ARGB32);
+    }
+
+    // All particles are black ink, so they are rendered straight into a
+    // single channel Alpha8 coverage buffer; render() expands it to ARGB32
+    static QImage renderCoverage(const Parameters& params, const std::vector<Particle>& particles,
+                                 RenderStats* stats = nullptr, const BenchOptions* options = nullptr) {
+        QImage coverage(params.canvasSize, params.canvasSize, QImage::Format_Alpha8);
+        TrackedBytes canvasBytes(MemoryTracker::Canvas, coverage.sizeInBytes());
+
+        if (supersampleFactor(params) > 1 || params.highPrecision) {
+            // The supersampled canvas would be up to 64x larger and the 16-bit
+            // one twice as large, so they are only ever held one band at a time
+            rasterBands(params, particles, copyRows(coverage), kBandHeight, false, stats, options);
+        } else {
+            coverage.fill(0);
+            const BenchOptions switches = options ? *options : BenchOptions();
+            RasterSetup setup = prepareRaster(params, switches);
+            VertexArena arena;
+            std::vector<Particle> sorted;
+            const std::vector<Particle>& order = submissionOrder(params, particles, sorted, switches);
+            TrackedBytes sortedBytes(MemoryTracker::Paths, (qint64)(sorted.capacity() * sizeof(Particle)));
+            rasterize(params, setup, arena, coverage, order, stats);
+        }
+        return coverage;
+    }
+
+    // Receives finished Alpha8 coverage rows [y, y + rows), top to bottom.
+    // Returning false cancels the render.
+    using BandSink = std::function<bool(const uchar* bits, qsizetype stride, int y, int rows)>;
+
+    // Rows per band at raster resolution
+    static constexpr int kBandHeight = 256;
+
+    // Out-of-core render for canvases too large to hold in memory: particles
+    // are placed once, binned by the bands they touch, and each band is
+    // rendered on its own and handed to the sink. Peak memory is one band
+    // plus the particle list, independent of the canvas area.
+    static bool renderBands(const Parameters& params, const BandSink& sink, int bandHeight = kBandHeight) {
+        return rasterBands(params, place(params), sink, bandHeight);
+    }
+
+    // 16-bit render for export: Grayscale16 transmittance, i.e. black ink on
+    // white paper, accumulated in high precision and never quantized
+    static QImage renderGrayscale16(const Parameters& params, const std::vector<Particle>& particles) {
+        QImage image(params.canvasSize, params.canvasSize, QImage::Format_Grayscale16);
+        TrackedBytes canvasBytes(MemoryTracker::Canvas, image.sizeInBytes());
+        rasterBands(params, particles, copyRows(image), kBandHeight, true);
+        return image;
+    }
+
+    // Outline radius r(t, i) for Parameters::radiusExpression: t is the angle
+    // in radians (phase-warped), i the particle index, and 1 is the particle's
+    // own radius. Null with a message in error if it does not compile.
+    static std::shared_ptr<const ShapeExpression> compileRadiusExpression(const QString& source, QString* error = nullptr) {
+        return ShapeExpression::compile(source, {"t", "i"}, error);
+    }
+
+    // Wavetable height z(u, v) for Parameters::waveExpression, with u and v
+    // across the tile from -pi to pi; ink where z is above the threshold
+    static std::shared_ptr<const ShapeExpression> compileWaveExpression(const QString& source, QString* error = nullptr) {
+        return ShapeExpression::compile(source, {"u", "v"}, error);
+    }
+
+    // Poisson-disk samples in the unit disk (Bridson's algorithm).
+    // The background grid holds at most one sample per cell, so each candidate
+    // only checks a 5x5 neighbourhood and generation stays O(n).
+    static std::vector<QPointF> poissonDiskSamples(int count, QRandomGenerator* rng) {
+        std::vector<QPointF> points;
+        if (count <= 0) return points;
+
+        // A maximal Poisson-disk set covers the unit disk with roughly 1.98 / r^2
+        // points, so start slightly denser and retry if we fall short
+        double radius = std::sqrt(1.9 / count);
+        for (int attempt = 0; attempt < 4; ++attempt) {
+            points = poissonDiskFill(radius, rng);
+            if ((int)points.size() >= count) break;
+            radius *= std::sqrt((double)points.size() / count) * 0.98;
+        }
+
+        // Drop the surplus at random so the remaining set still covers the disk
+        while ((int)points.size() > count) {
+            int k = rng->bounded((int)points.size());
+            points[k] = points.back();
+            points.pop_back();
+        }
+        return points;
+    }
+
+private:
+    enum Distribution { DistRandom = 0, DistGrid = 1, DistSpiral = 2, DistBlueNoise = 3, DistDensityMap = 4 };
+    enum ShapeKind { ShapeEllipse = 0, ShapeOutline = 1, ShapeStamp = 2 };
+
+    // Kernel flag layouts. kGenericKernel reads every mode from the parameters
+    // at runtime and is kept as the reference the specializations must match.
+    static constexpr int kGenericKernel = -1;
+    enum PlacementFlag { kFalloff = 1, kSquareness = 2 }; // Distribution in bits 2+
+    enum RasterFlag { kPolygon = 1, kEdgeModulation = 2, kPhaseWarp = 4 }; // ShapeKind in bits 3+
+    static constexpr int kPlacementVariants = 5 << 2;
+    static constexpr int kRasterVariants = 3 << 3;
+
+    // Tiles used to order particles for cache locality (64 px)
+    static constexpr int kSortTileShift = 6;
+    static constexpr int kMaxOutlineSteps = 1024;
+    // Expression radii are clamped to [0, this] times the particle radius
+    static constexpr double kMaxExpressionRadius = 2.0;
+
+    // Outline step count as a function of particle radius r:
+    // perSqrtRadius * sqrt(r), rounded up to a multiple
+    struct OutlineSteps {
+        double perSqrtRadius = 0;
+        int multiple = 1;
+        int legacyMinimum = -1; // >= 0: the legacy size rule with this floor
+
+        int operator()(double radius) const {
+            if (legacyMinimum >= 0) return std::max(30 + std::min((int)std::lround(2.0 * radius), 100), legacyMinimum);
+            int steps = (int)std::ceil(perSqrtRadius * std::sqrt(radius));
+            steps = std::clamp(steps, 3, kMaxOutlineSteps);
+            return (steps + multiple - 1) / multiple * multiple;
+        }
+    };
+
+    // Scratch outline vertices. Allocated once per render and rewound for
+    // every particle, so outline generation does no per-particle allocation.
+    class VertexArena {
+    public:
+        void reserve(int count) {
+            if ((int)m_vertices.size() < count) {
+                m_vertices.resize(count);
+                m_bytes.set((qint64)(m_vertices.capacity() * sizeof(QPointF)));
+            }
+        }
+
+        QPointF* vertices(int count) {
+            reserve(count);
+            return m_vertices.data();
+        }
+
+    private:
+        std::vector<QPointF> m_vertices;
+        TrackedBytes m_bytes{MemoryTracker::Paths};
+    };
+
+    // Render-wide raster state that does not depend on the target buffer
+    struct RasterSetup {
+        std::shared_ptr<const StampMipChain> stamp;
+        double shapeFill = M_PI / 4.0;
+        double pRound = 1.0;
+        double polygonSides = 0;
+        double rotationOffset = 0;
+        OutlineSteps outlineSteps;
+        BenchOptions options;
+    };
+
+    struct RasterContext {
+        const Parameters* params = nullptr;
+        QPainter* painter = nullptr;
+        VertexArena* arena = nullptr;
+        uchar* bits = nullptr;
+        int stride = 0;
+        int width = 0;
+        int height = 0;
+        bool transmittance16 = false; // Grayscale16 target instead of Alpha8
+        const StampMipChain* stamp = nullptr;
+        SaturationMask* saturation = nullptr; // Null when skipping is off
+        RenderStats* stats = nullptr;
+        double shapeFill = M_PI / 4.0; // Ink fraction of the bounding square, for splats
+        double pRound = 1.0;
+        double polygonSides = 0; // 0 means circle
+        double rotationOffset = 0;
+        OutlineSteps outlineSteps;
+        const ShapeExpression* radiusExpression = nullptr; // Expression outline, null otherwise
+    };
+
+    using PlacementFn = void (*)(const Parameters&, std::vector<Particle>&);
+    using RasterFn = void (*)(const RasterContext&, const std::vector<Particle>&);
+
+    template <typename Fn, int Count, typename Make, int... I>
+    static constexpr std::array<Fn, Count> makeKernelTable(Make make, std::integer_sequence<int, I...>) {
+        return {{ make(std::integral_constant<int, I>())... }};
+    }
+
+    template <typename Fn, int Count, typename Make>
+    static constexpr std::array<Fn, Count> makeKernelTable(Make make) {
+        return makeKernelTable<Fn, Count>(make, std::make_integer_sequence<int, Count>());
+    }
+
+    static int placementDistribution(const Parameters& params) {
+        if (params.distType == DistDensityMap && !params.densityMap) return DistRandom; // Falls back to Random
+        if (params.distType < DistRandom || params.distType > DistDensityMap) return DistRandom;
+        return params.distType;
+    }
+
+    static int placementFlags(const Parameters& params) {
+        int dist = placementDistribution(params);
+        int flags = dist << 2;
+        // The density map already defines both density and boundary
+        if (dist != DistDensityMap) {
+            if (params.falloff > 0) flags |= kFalloff;
+            bool squareness = (dist == DistGrid) ? params.distributionSquareness < 100 : params.distributionSquareness > 0;
+            if (squareness) flags |= kSquareness;
+        }
+        return flags;
+    }
+
+    // Wavetable, or an image shape with an image loaded; without one it draws circles
+    static bool usesStamp(const Parameters& params) {
+        return params.shapeId == 4 || (params.shapeId == 5 && params.stampImage);
+    }
+
+    // Expression shape with a compiled radius; without one it draws circles
+    static bool usesExpression(const Parameters& params) {
+        return params.shapeId == 6 && params.radiusExpression;
+    }
+
+    static int rasterFlags(const Parameters& params) {
+        const bool circle = params.shapeId == 0 || params.shapeId == 5 || (params.shapeId == 6 && !usesExpression(params));
+        int kind = ShapeOutline;
+        if (usesStamp(params)) kind = ShapeStamp;
+        else if (circle && params.shapeEdgeFreq == 0) kind = ShapeEllipse;
+
+        int flags = kind << 3;
+        if (params.shapeId >= 1 && params.shapeId <= 3) flags |= kPolygon;
+        // An expression defines the whole radius; only the phase warp still applies
+        if (params.shapeEdgeFreq > 0 && params.shapeEdgeAmp > 0 && !usesExpression(params)) flags |= kEdgeModulation;
+        if (params.shapeWarpAmp > 0 && params.shapeWarpFreq > 0) flags |= kPhaseWarp;
+        return flags;
+    }
+
+    // Largest particle diameter the size jitter can produce
+    static double maxParticleSize(const Parameters& params) {
+        double sizeVar = params.sizeMean * (params.sizeJitter / 100.0);
+        return params.sizeMean + sizeVar;
+    }
+
+    // Farthest a particle of this diameter can paint from its centre (px)
+    static double particleReach(const Parameters& params, int size) {
+        double reach = size / 2.0;
+        if (usesStamp(params)) reach *= std::sqrt(2.0); // Rotated stamp square
+        else if (usesExpression(params)) reach *= kMaxExpressionRadius;
+        else if (params.shapeEdgeAmp > 0) reach *= 1.0 + params.shapeEdgeAmp / 100.0;
+        return reach + 2.0; // Antialiasing and splat footprint
+    }
+
+    // Interleaves the bits of two 16-bit tile coordinates (Z-order curve)
+    static quint32 mortonKey(quint32 x, quint32 y) {
+        auto spread = [](quint32 v) {
+            v = (v | (v << 8)) & 0x00FF00FFu;
+            v = (v | (v << 4)) & 0x0F0F0F0Fu;
+            v = (v | (v << 2)) & 0x33333333u;
+            v = (v | (v << 1)) & 0x55555555u;
+            return v;
+        };
+        return spread(x) | (spread(y) << 1);
+    }
+
+    // Stable counting sort by the Morton key of the tile holding each centre,
+    // so consecutive draws land on cache lines that are still warm. Black ink
+    // composites as a product of transmittances, which commutes, so this only
+    // moves rounding; particles sharing a tile keep their emission order.
+    static void spatialOrder(const std::vector<Particle>& particles, int width, int height,
+                             std::vector<Particle>& sorted) {
+        const int tileSize = 1 << kSortTileShift;
+        const int tilesX = std::max(1, (width + tileSize - 1) >> kSortTileShift);
+        const int tilesY = std::max(1, (height + tileSize - 1) >> kSortTileShift);
+        int side = 1;
+        while (side < std::max(tilesX, tilesY)) side *= 2;
+
+        auto key = [&](const Particle& p) {
+            int tx = std::clamp((int)std::floor(p.x) >> kSortTileShift, 0, tilesX - 1);
+            int ty = std::clamp((int)std::floor(p.y) >> kSortTileShift, 0, tilesY - 1);
+            return mortonKey((quint32)tx, (quint32)ty);
+        };
+        std::vector<quint32> start((size_t)side * side + 1, 0);
+        for (const Particle& p : particles) ++start[key(p) + 1];
+        for (size_t k = 1; k < start.size(); ++k) start[k] += start[k - 1];
+
+        sorted.resize(particles.size());
+        for (const Particle& p : particles) sorted[start[key(p)]++] = p;
+    }
+
+    // Raster submission order: the particles as emitted, or a Z-order copy in
+    // sorted. Decided in canvas space so banded renders see the same order.
+    static const std::vector<Particle>& submissionOrder(const Parameters& params, const std::vector<Particle>& particles,
+                                                        std::vector<Particle>& sorted, const BenchOptions& options) {
+        // Splats touch too few pixels to repay the sort's own scattered writes
+        if (!options.spatialSort || params.sizeMean * supersampleFactor(params) <= kSplatMaxSize) return particles;
+        spatialOrder(particles, params.canvasSize, params.canvasSize, sorted);
+        return sorted;
+    }
+
+    static RasterSetup prepareRaster(const Parameters& params, const BenchOptions& options) {
+        RasterSetup setup;
+        setup.options = options;
+        if (params.shapeId == 4) {
+            QImage wavetableImage = makeWavetable(params);
+            TrackedBytes wavetableBytes(MemoryTracker::Stamp, wavetableImage.sizeInBytes());
+            setup.stamp = StampMipChain::fromImage(wavetableImage);
+            setup.shapeFill = averageAlpha(wavetableImage);
+        } else if (usesStamp(params)) {
+            setup.stamp = params.stampImage;
+            setup.shapeFill = params.stampImage->inkFraction();
+        }
+
+        setup.pRound = params.particleRoundness / 100.0;
+        if (setup.pRound < 0.01) setup.pRound = 0.01;
+
+        // Determine Polygon Properties
+        if (params.shapeId == 1) { // Triangle
+            setup.polygonSides = 3.0;
+            setup.rotationOffset = M_PI / 6.0; // Rotate to point up
+        } else if (params.shapeId == 2) { // Square
+            setup.polygonSides = 4.0;
+            setup.rotationOffset = M_PI / 4.0; // Rotate to align with axes
+        } else if (params.shapeId == 3) { // Polygon
+            setup.polygonSides = std::max(3, params.polygonSides);
+            setup.rotationOffset = -M_PI / 2.0; // Usually start at top
+        }
+        setup.outlineSteps = outlineStepModel(params, setup.polygonSides, options);
+        return setup;
+    }
+
+    // Fewest uniform steps in t that keep an outline within the tolerance of
+    // the curve it samples, P(t) = R(t) (cos t, sin t). The chord over a step
+    // h strays at most h^2 max|P''| / 8 from it, and |P''| <= R + 2|R'| + |R''|.
+    // R = r * polygon(tau) * wave(tau), with the phase warp running t through
+    // tau = t + w sin(kt), so every bound is r times a per-shape constant and
+    // the step count grows with sqrt(r). The bound only holds between polygon
+    // corners: unwarped polygons start on a corner and put a vertex on every
+    // one, warped ones get the exact corner inserted where it is crossed.
+    static OutlineSteps outlineStepModel(const Parameters& params, double polygonSides, const BenchOptions& options) {
+        if (options.legacyOutlineSteps) {
+            OutlineSteps steps;
+            steps.legacyMinimum = params.shapeEdgeFreq * 4; // Raised for high edge frequencies
+            return steps;
+        }
+        if (usesExpression(params)) return expressionStepModel(params);
+        const int flags = rasterFlags(params);
+        const bool polygon = (flags & kPolygon) != 0;
+        const bool edgeModulation = (flags & kEdgeModulation) != 0;
+        const bool phaseWarp = (flags & kPhaseWarp) != 0;
+        const double tolerance = std::max(0.01, params.outlineTolerance);
+
+        const double a = edgeModulation ? params.shapeEdgeAmp / 100.0 : 0.0;
+        const double f = edgeModulation ? params.shapeEdgeFreq : 0.0;
+        const double w = phaseWarp ? params.shapeWarpAmp / 50.0 : 0.0;
+        const double k = phaseWarp ? params.shapeWarpFreq : 0.0;
+        const double speed = 1.0 + w * k; // Bounds |dtau/dt|
+        const double accel = w * k * k;   // Bounds |d2tau/dt2|
+
+        // Wave 1 + a sin(f tau + phase) and its t derivatives
+        const double g0 = 1.0 + a;
+        const double g1 = a * f * speed;
+        const double g2 = a * (f * f * speed * speed + f * accel);
+
+        // Polygon apothem / cos(he) <= 1, with |p'| <= tan(pi/n) and |p''| <= 1 + 2 tan^2(pi/n)
+        double p1 = 0, p2 = 0;
+        if (polygon) {
+            const double tanHalf = std::tan(M_PI / polygonSides);
+            p1 = tanHalf * speed;
+            p2 = (1.0 + 2.0 * tanHalf * tanHalf) * speed * speed + tanHalf * accel;
+        }
+
+        // Bounds on R, R' and R'' per unit radius (product rule)
+        const double r0 = g0;
+        const double r1 = p1 * g0 + g1;
+        const double r2 = p2 * g0 + 2.0 * p1 * g1 + g2;
+
+        OutlineSteps steps;
+        const bool straightEdges = polygon && !phaseWarp && !edgeModulation;
+        if (!straightEdges) steps.perSqrtRadius = M_PI * std::sqrt((r0 + 2.0 * r1 + r2) / (2.0 * tolerance));
+        if (polygon && !phaseWarp) steps.multiple = (int)std::lround(polygonSides);
+        return steps;
+    }
+
+    // Expression radius as drawn: clamped, and 0 where it is not a number
+    static double expressionRadius(float r) {
+        return std::isfinite(r) ? std::clamp((double)r, 0.0, kMaxExpressionRadius) : 0.0;
+    }
+
+    // The same bound for an expression outline, whose derivatives are not
+    // known in closed form: max |r|, |r'| and |r''| are measured with finite
+    // differences over a fine sweep of tau for the first few particle
+    // indices, then scaled by the phase warp like the built-in shapes. A
+    // discontinuous expression measures huge and gets the most steps.
+    static OutlineSteps expressionStepModel(const Parameters& params) {
+        constexpr int kSamples = 1024;
+        constexpr int kIndices = 8;
+        const double h = 2 * M_PI / kSamples;
+        const int flags = rasterFlags(params);
+        const bool phaseWarp = (flags & kPhaseWarp) != 0;
+        const double tolerance = std::max(0.01, params.outlineTolerance);
+
+        std::vector<float> t(kSamples + 2), index(kSamples + 2), r(kSamples + 2);
+        for (int j = 0; j < kSamples + 2; ++j) t[j] = (float)((j - 1) * h);
+        double m0 = 0, m1 = 0, m2 = 0;
+        for (int i = 0; i < kIndices; ++i) {
+            std::fill(index.begin(), index.end(), (float)i);
+            const float* inputs[] = {t.data(), index.data()};
+            params.radiusExpression->evaluate(inputs, r.data(), kSamples + 2);
+            for (float& v : r) v = (float)expressionRadius(v);
+            for (int j = 1; j <= kSamples; ++j) {
+                m0 = std::max(m0, (double)r[j]);
+                m1 = std::max(m1, std::abs(r[j + 1] - r[j - 1]) / (2.0 * h));
+                m2 = std::max(m2, std::abs(r[j + 1] - 2.0 * r[j] + r[j - 1]) / (h * h));
+            }
+        }
+
+        const double w = phaseWarp ? params.shapeWarpAmp / 50.0 : 0.0;
+        const double k = phaseWarp ? params.shapeWarpFreq : 0.0;
+        const double speed = 1.0 + w * k;
+        const double accel = w * k * k;
+        const double r1 = m1 * speed;
+        const double r2 = m2 * speed * speed + m1 * accel;
+
+        OutlineSteps steps;
+        steps.perSqrtRadius = M_PI * std::sqrt((m0 + 2.0 * r1 + r2) / (2.0 * tolerance));
+        return steps;
+    }
+
+    // Draws particles into an Alpha8 coverage image, or a Grayscale16
+    // transmittance image, using the kernel for the current modes
+    static void rasterize(const Parameters& params, const RasterSetup& setup, VertexArena& arena,
+                          QImage& coverage, const std::vector<Particle>& particles, RenderStats* stats = nullptr) {
+        static const auto kernels = makeKernelTable<RasterFn, kRasterVariants>(
+            [](auto flags) { return &rasterParticles<decltype(flags)::value>; });
+
+        RasterContext ctx;
+        ctx.params = &params;
+        ctx.bits = coverage.bits(); // Before the painter attaches, so it never detaches
+        ctx.stride = (int)coverage.bytesPerLine();
+        ctx.width = coverage.width();
+        ctx.height = coverage.height();
+        ctx.transmittance16 = coverage.format() == QImage::Format_Grayscale16;
+        ctx.stamp = setup.stamp.get();
+        ctx.shapeFill = setup.shapeFill;
+        ctx.pRound = setup.pRound;
+        ctx.polygonSides = setup.polygonSides;
+        ctx.rotationOffset = setup.rotationOffset;
+        ctx.outlineSteps = setup.outlineSteps;
+        ctx.radiusExpression = usesExpression(params) ? params.radiusExpression.get() : nullptr;
+        ctx.stats = stats;
+
+        // Tiles that are already fully inked let later particles be skipped
+        SaturationMask saturation;
+        if (setup.options.skipSaturated) {
+            saturation.reset(ctx.bits, ctx.stride, ctx.width, ctx.height, ctx.transmittance16 ? 2 : 1);
+            ctx.saturation = &saturation;
+        }
+
+        // One outline buffer for the whole render, sized for the largest step count
+        arena.reserve(2 * setup.outlineSteps(maxParticleSize(params) / 2.0) + 1);
+        ctx.arena = &arena;
+
+        QPainter painter(&coverage);
+        painter.setRenderHint(QPainter::Antialiasing, analyticAntialiasing(params));
+        painter.setBrush(QColor(0, 0, 0, 255));
+        painter.setPen(Qt::NoPen);
+        ctx.painter = &painter;
+
+        RasterFn kernel = setup.options.specializeKernels ? kernels[rasterFlags(params)] : &rasterParticles<kGenericKernel>;
+        kernel(ctx, particles);
+        painter.end();
+    }
+
+    // Supersampling factor per axis. Capped so the supersampled canvas stays
+    // inside the 16.16 fixed point range of QPainter's aliased rasterizer.
+    static int supersampleFactor(const Parameters& params) {
+        int factor = params.supersampling;
+        if (factor != 2 && factor != 4 && factor != 8) return 1;
+        while (factor > 1 && (qint64)params.canvasSize * factor > 32768) factor /= 2;
+        return factor;
+    }
+
+    // Analytic anti-aliasing is drawn for level 0, and also for a
+    // supersampling level the cap drops to 1, rather than no anti-aliasing
+    static bool analyticAntialiasing(const Parameters& params) {
+        return params.supersampling == 0 || (params.supersampling > 1 && supersampleFactor(params) == 1);
+    }
+
+    // Sink that copies band rows into a preallocated image of the band format
+    static BandSink copyRows(QImage& image) {
+        uchar* bits = image.bits();
+        const qsizetype bytesPerLine = image.bytesPerLine();
+        const int rowBytes = image.width() * image.depth() / 8;
+        return [=](const uchar* band, qsizetype stride, int y, int rows) {
+            for (int r = 0; r < rows; ++r) {
+                std::copy(band + r * stride, band + r * stride + rowBytes, bits + (y + r) * bytesPerLine);
+            }
+            return true;
+        };
+    }
+
+public:
+    // Renders in horizontal bands, supersampled when requested: each band is
+    // drawn aliased at factor x resolution and box-filtered down before it
+    // reaches the sink. High precision bands are drawn as 16-bit
+    // transmittance and dithered to 8-bit coverage last, unless grayscale16
+    // asks for the transmittance rows themselves. Bands are rendered on
+    // request so several renders can be stepped together (layer compositing);
+    // the particles must outlive the renderer.
+    class BandRenderer {
+    public:
+        BandRenderer(const Parameters& params, const std::vector<Particle>& emitted, int bandHeight = kBandHeight,
+                     bool grayscale16 = false, RenderStats* stats = nullptr, const BenchOptions* options = nullptr)
+            : m_params(params), m_raster(params), m_grayscale16(grayscale16), m_stats(stats) {
+            const BenchOptions switches = options ? *options : BenchOptions();
+            const int size = params.canvasSize;
+            m_factor = supersampleFactor(params);
+            m_bandHeight = std::clamp(bandHeight / m_factor, 1, std::max(1, size));
+            m_bandCount = (size + m_bandHeight - 1) / m_bandHeight;
+            m_particles = &submissionOrder(params, emitted, m_sorted, switches);
+
+            // Counting sort into per-band index lists, keeping submission order
+            // within each band so overlaps composite exactly as in render()
+            m_binStart.assign(m_bandCount + 1, 0);
+            for (const Particle& p : *m_particles) {
+                int first, last;
+                bandRange(p, first, last);
+                for (int b = first; b <= last; ++b) ++m_binStart[b + 1];
+            }
+            for (int b = 0; b < m_bandCount; ++b) m_binStart[b + 1] += m_binStart[b];
+
+            m_binned.resize(m_binStart[m_bandCount]);
+            std::vector<quint32> cursor(m_binStart.begin(), m_binStart.end() - 1);
+            for (quint32 i = 0; i < m_particles->size(); ++i) {
+                int first, last;
+                bandRange((*m_particles)[i], first, last);
+                for (int b = first; b <= last; ++b) m_binned[cursor[b]++] = i;
+            }
 
-        QPainter painter(&image);
-        painter.setRenderHint(QPainter::Antialiasing);
+            // Raster resolution parameters; particle sizes are scaled per band below.
+            // The bands draw either analytic or aliased; supersampling is done here.
+            m_raster.canvasSize = size * m_factor;
+            m_raster.sizeMean = params.sizeMean * m_factor;
+            m_raster.supersampling = analyticAntialiasing(params) ? 0 : 1;
 
-        auto* rng = QRandomGenerator::global();
+            m_precise = params.highPrecision || grayscale16;
+            const QImage::Format rasterFormat = m_precise ? QImage::Format_Grayscale16 : QImage::Format_Alpha8;
+
+            m_setup = prepareRaster(m_raster, switches);
+            m_band = QImage(size * m_factor, m_bandHeight * m_factor, rasterFormat);
+            if (m_factor > 1) {
+                m_downsampled = QImage(size, m_bandHeight, rasterFormat);
+                if (m_precise) m_scratch32.resize((size_t)size * m_factor);
+                else m_scratch.resize((size_t)size * m_factor);
+            }
+            if (m_precise && !grayscale16) m_quantized = QImage(size, m_bandHeight, QImage::Format_Alpha8);
+            m_bufferBytes.set(m_band.sizeInBytes() + m_downsampled.sizeInBytes() + m_quantized.sizeInBytes()
+                              + (qint64)(m_scratch.capacity() * sizeof(uint16_t) + m_scratch32.capacity() * sizeof(uint32_t)));
+            trackPaths();
+        }
+
+        BandRenderer(const BandRenderer&) = delete;
+        BandRenderer& operator=(const BandRenderer&) = delete;
+
+        int bandCount() const { return m_bandCount; }
+        int bandHeight() const { return m_bandHeight; } // Output rows per band
+
+        // Renders band b and hands its rows to the sink; returns the sink's answer
+        bool renderBand(int b, const BandSink& sink) {
+            const int size = m_params.canvasSize;
+            const int factor = m_factor;
+            const int y0 = b * m_bandHeight;
+            const int rows = std::min(m_bandHeight, size - y0);
+
+            // Shift into band space at raster resolution; whole-pixel offsets keep antialiasing identical
+            m_bandParticles.clear();
+            for (quint32 k = m_binStart[b]; k < m_binStart[b + 1]; ++k) {
+                Particle p = (*m_particles)[m_binned[k]];
+                p.x *= factor;
+                p.y = (p.y - y0) * factor;
+                p.size *= factor;
+                m_bandParticles.push_back(p);
+            }
+            trackPaths();
+
+            m_band.fill(m_precise ? 0xFFFFu : 0u); // Clear: no coverage, full transmittance
+            rasterize(m_raster, m_setup, m_arena, m_band, m_bandParticles, m_stats);
+
+            const QImage* out = &m_band;
+            if (factor > 1) {
+                const qsizetype step = (qsizetype)factor * m_band.bytesPerLine();
+                for (int r = 0; r < rows; ++r) {
+                    if (m_precise) {
+                        RasterKernels::downsampleBox16(reinterpret_cast<const uint16_t*>(m_band.constBits() + r * step),
+                                                       m_band.bytesPerLine(), reinterpret_cast<uint16_t*>(m_downsampled.scanLine(r)),
+                                                       size, factor, m_scratch32.data());
+                    } else {
+                        RasterKernels::downsampleBox(m_band.constBits() + r * step, m_band.bytesPerLine(),
+                                                     m_downsampled.scanLine(r), size, factor, m_scratch.data());
+                    }
+                }
+                out = &m_downsampled;
+            }
+            if (m_precise && !m_grayscale16) {
+                for (int r = 0; r < rows; ++r) {
+                    RasterKernels::quantizeDither(reinterpret_cast<const uint16_t*>(out->constScanLine(r)),
+                                                  m_quantized.scanLine(r), size, y0 + r);
+                }
+                out = &m_quantized;
+            }
+            return sink(out->constBits(), out->bytesPerLine(), y0, rows);
+        }
+
+    private:
+        // Binned and sorted particle copies; the band list grows to the busiest band
+        void trackPaths() {
+            m_pathBytes.set((qint64)((m_sorted.capacity() + m_bandParticles.capacity()) * sizeof(Particle)
+                                     + (m_binStart.capacity() + m_binned.capacity()) * sizeof(quint32)));
+        }
+
+        void bandRange(const Particle& p, int& first, int& last) const {
+            double reach = particleReach(m_params, p.size);
+            first = std::clamp((int)std::floor((p.y - reach) / m_bandHeight), 0, m_bandCount - 1);
+            last = std::clamp((int)std::floor((p.y + reach) / m_bandHeight), 0, m_bandCount - 1);
+        }
+
+        Parameters m_params;
+        Parameters m_raster;
+        bool m_grayscale16;
+        bool m_precise = false;
+        RenderStats* m_stats;
+        int m_factor = 1;
+        int m_bandHeight = 1;
+        int m_bandCount = 0;
+        const std::vector<Particle>* m_particles = nullptr;
+        std::vector<Particle> m_sorted;
+        std::vector<quint32> m_binStart;
+        std::vector<quint32> m_binned;
+        std::vector<Particle> m_bandParticles;
+        RasterSetup m_setup;
+        VertexArena m_arena;
+        QImage m_band;
+        QImage m_downsampled;
+        QImage m_quantized;
+        std::vector<uint16_t> m_scratch;
+        std::vector<uint32_t> m_scratch32;
+        TrackedBytes m_bufferBytes{MemoryTracker::Canvas};
+        TrackedBytes m_pathBytes{MemoryTracker::Paths};
+    };
+
+private:
+    static bool rasterBands(const Parameters& params, const std::vector<Particle>& particles,
+                            const BandSink& sink, int bandHeight, bool grayscale16 = false,
+                            RenderStats* stats = nullptr, const BenchOptions* options = nullptr) {
+        BandRenderer renderer(params, particles, bandHeight, grayscale16, stats, options);
+        for (int b = 0; b < renderer.bandCount(); ++b) {
+            if (!renderer.renderBand(b, sink)) return false;
+        }
+        return true;
+    }
+
+    template <int Flags>
+    static void placeParticles(const Parameters& params, std::vector<Particle>& particles) {
+        // Constant for specializations, so the branches below fold away
+        constexpr bool generic = Flags == kGenericKernel;
+        const int flags = generic ? placementFlags(params) : Flags;
+        const int dist = flags >> 2;
+        const bool useFalloff = (flags & kFalloff) != 0;
+        const bool useSquareness = (flags & kSquareness) != 0;
+
+        // A fixed seed makes the whole render reproducible
+        QRandomGenerator seededRng(params.seed);
+        QRandomGenerator* rng = params.seed != 0 ? &seededRng : QRandomGenerator::global();
         double centerX = params.canvasSize / 2.0;
         double centerY = params.canvasSize / 2.0;
-        
+
         // Calculate max particle radius to avoid clipping
-        double sizeVar = params.sizeMean * (params.sizeJitter / 100.0);
-        double maxSize = params.sizeMean + sizeVar;
-        double maxParticleRadius = maxSize / 2.0;
-        
+        double maxParticleRadius = maxParticleSize(params) / 2.0;
+
         // Account for Edge Modulation (Amplitude)
         if (params.shapeEdgeAmp > 0) {
             maxParticleRadius *= (1.0 + params.shapeEdgeAmp / 100.0);
         }
-        
+
         // Ensure we don't reduce radius to negative
         double margin = maxParticleRadius + 2.0; // +2 for safety
         double maxRadius = (params.canvasSize / 2.0) - margin;
         if (maxRadius < 1.0) maxRadius = 1.0;
 
-        // Pre-generate Wavetable Particle if needed
-        QImage wavetableImage;
-        if (params.shapeId == 4) {
-            int size = std::ceil(maxSize);
-            if (size < 1) size = 1;
-            wavetableImage = QImage(size, size, QImage::Format_ARGB32);
-            wavetableImage.fill(Qt::transparent);
-
-            // Wavetable Generation (FM Synthesis Style)
-            // Z = sin(u * fx + FM * sin(v * fy + phase))
-            // Cutoff at threshold
-            
-            double freqX = std::max(1.0, (double)params.shapeEdgeFreq);
-            double freqY = std::max(1.0, (double)params.shapeWarpFreq); // Modulator Freq
-            double fmAmount = params.shapeEdgeAmp / 20.0; // FM Index
-            double phaseY = params.shapeWarpAmp / 100.0 * 2.0 * M_PI;
-            double threshold = (params.waveThreshold / 50.0) - 1.0; // Map 0..100 to -1..1
-            
-            // Invert threshold logic: User likely wants "Amount of shape", so 100% means full square, 0% means nothing.
-            // Or "Threshold" means Cutoff Level.
-            // User said "Keep high parts". So High Threshold = Less pixels.
-            // Let's stick to "Threshold". 0 = Keep Everything (Full Square), 100 = Keep Nothing (Peaks only).
-            // So T = map(val, 0, 100, -1.0, 1.0).
-            
-            for (int y = 0; y < size; ++y) {
-                QRgb* scanLine = (QRgb*)wavetableImage.scanLine(y);
-                double v = (double)y / size * 2.0 * M_PI - M_PI; // -PI to PI
-                
-                for (int x = 0; x < size; ++x) {
-                    double u = (double)x / size * 2.0 * M_PI - M_PI; // -PI to PI
-                    
-                    // FM Formula
-                    // Modulator
-                    double mod = std::sin(v * freqY + phaseY);
-                    
-                    // Carrier
-                    double signal = std::sin(u * freqX + fmAmount * mod);
-                    
-                    // To make it more interesting, let's mix X and Y?
-                    // The above is strictly horizontal waves modulated vertically.
-                    // If we want "Cells", we need interference.
-                    // Let's add a vertical carrier component too?
-                    // signal = (sin(...) + sin(v * freqY)) / 2
-                    
-                    // User asked for "Wavetable Cross Section".
-                    // Let's try: Z = sin(u*fx) * sin(v*fy). This makes Grid.
-                    // With FM: Z = sin(u*fx + mod) * sin(v*fy + mod) ?
-                    
-                    // Let's go with the "Interference" model (Sum):
-                    // Z = (sin(u * fx + fm * mod) + sin(v * fy + phaseY)) / 2.0
-                    
-                    double z = (std::sin(u * freqX + fmAmount * mod) + std::sin(v * freqY + phaseY)) / 2.0;
-                    
-                    if (z > threshold) {
-                        // Anti-aliasing
-                        double edge = std::min(1.0, (z - threshold) * 10.0); // Soft edge
-                        int alpha = (int)(edge * 255);
-                        scanLine[x] = qRgba(0, 0, 0, alpha);
-                    } else {
-                        scanLine[x] = qRgba(0, 0, 0, 0);
-                    }
-                }
-            }
-        }
-
         double angleRad = params.angle * M_PI / 180.0;
         double cosA = std::cos(angleRad);
         double sinA = std::sin(angleRad);
         double roundnessFactor = params.roundness / 100.0;
         if (roundnessFactor < 0.01) roundnessFactor = 0.01;
 
+        // Blue noise points are generated as a set up front (unit disk)
+        std::vector<QPointF> blueNoise;
+        if (dist == DistBlueNoise) {
+            blueNoise = poissonDiskSamples(params.count, rng);
+        }
+        const DensityMap* densityMap = params.densityMap.get();
+
+        int gridSide = std::max(1, (int)std::ceil(std::sqrt(params.count)));
+        double sizeVar = params.sizeMean * (params.sizeJitter / 100.0);
+        double opacityVar = params.opacityMean * (params.opacityJitter / 100.0);
+        double falloffPower = 1.0 + (params.falloff / 20.0);
+        double squareness = params.distributionSquareness / 100.0;
+        double jitter = params.distJitter / 50.0;
+        double angleJitterRange = 360.0 * (params.particleAngleJitter / 100.0);
+
+        particles.clear();
+        particles.reserve(params.count);
+
         for (int i = 0; i < params.count; ++i) {
             // Size calculation
-            double sizeVar = params.sizeMean * (params.sizeJitter / 100.0);
             int s = std::round(params.sizeMean + rng->generateDouble() * 2.0 * sizeVar - sizeVar);
             if (s < 1) s = 1;
-            double radius = s / 2.0;
 
             // Opacity calculation
-            double opacityVar = params.opacityMean * (params.opacityJitter / 100.0);
             int alpha = std::round(params.opacityMean + rng->generateDouble() * 2.0 * opacityVar - opacityVar);
             if (alpha < 0) alpha = 0;
             if (alpha > 255) alpha = 255;
@@ -158,39 +859,57 @@ public:
             double u, v; // Normalized coords
             double r_norm, theta;
 
-            if (params.distType == 1) { // Grid
-                int side = std::ceil(std::sqrt(params.count));
-                if (side < 1) side = 1;
-                int row = i / side;
-                int col = i % side;
-                
+            if (dist == DistGrid) {
+                int row = i / gridSide;
+                int col = i % gridSide;
+
                 // Normalized -1..1
-                u = (side > 1) ? ((double)col / (side - 1) * 2.0 - 1.0) : 0;
-                v = (side > 1) ? ((double)row / (side - 1) * 2.0 - 1.0) : 0;
-                
+                u = (gridSide > 1) ? ((double)col / (gridSide - 1) * 2.0 - 1.0) : 0;
+                v = (gridSide > 1) ? ((double)row / (gridSide - 1) * 2.0 - 1.0) : 0;
+
                 if (params.distJitter > 0) {
-                    double cell = 2.0 / side;
-                    u += (rng->generateDouble() - 0.5) * cell * (params.distJitter / 50.0);
-                    v += (rng->generateDouble() - 0.5) * cell * (params.distJitter / 50.0);
+                    double cell = 2.0 / gridSide;
+                    u += (rng->generateDouble() - 0.5) * cell * jitter;
+                    v += (rng->generateDouble() - 0.5) * cell * jitter;
                 }
-                
+
                 r_norm = std::sqrt(u*u + v*v);
                 theta = std::atan2(v, u);
-            } else if (params.distType == 2) { // Spiral (Phyllotaxis)
-                double angle = i * 2.3999632; 
+            } else if (dist == DistSpiral) { // Phyllotaxis
+                double angle = i * 2.3999632;
                 r_norm = std::sqrt((double)i / params.count);
-                
+
                 u = r_norm * std::cos(angle);
                 v = r_norm * std::sin(angle);
                 theta = angle;
-                
+
                 if (params.distJitter > 0) {
-                    double jitterScale = 0.1; 
-                    u += (rng->generateDouble() - 0.5) * jitterScale * (params.distJitter / 50.0);
-                    v += (rng->generateDouble() - 0.5) * jitterScale * (params.distJitter / 50.0);
+                    double jitterScale = 0.1;
+                    u += (rng->generateDouble() - 0.5) * jitterScale * jitter;
+                    v += (rng->generateDouble() - 0.5) * jitterScale * jitter;
                     r_norm = std::sqrt(u*u + v*v);
                     theta = std::atan2(v, u);
                 }
+            } else if (dist == DistBlueNoise) { // Poisson-disk
+                if (i >= (int)blueNoise.size()) break;
+                u = blueNoise[i].x();
+                v = blueNoise[i].y();
+
+                if (params.distJitter > 0) {
+                    // Jitter relative to the point spacing so 100% roughly reaches the neighbours
+                    double jitterScale = std::sqrt(2.0 / params.count);
+                    u += (rng->generateDouble() - 0.5) * jitterScale * jitter;
+                    v += (rng->generateDouble() - 0.5) * jitterScale * jitter;
+                }
+
+                r_norm = std::sqrt(u*u + v*v);
+                theta = std::atan2(v, u);
+            } else if (dist == DistDensityMap) { // Alias table, O(1) per sample
+                QPointF p = densityMap->sample(rng);
+                u = p.x();
+                v = p.y();
+                r_norm = std::sqrt(u*u + v*v);
+                theta = std::atan2(v, u);
             } else { // Random (Default)
                 r_norm = std::sqrt(rng->generateDouble()); // Uniform area
                 theta = rng->generateDouble() * 2 * M_PI;
@@ -198,10 +917,9 @@ public:
                 v = r_norm * std::sin(theta);
             }
 
-            // 1. Falloff (Radial Warp) - Apply to all
-            if (params.falloff > 0) {
-                double p = 1.0 + (params.falloff / 20.0); 
-                double new_r = std::pow(r_norm, p);
+            // 1. Falloff (Radial Warp)
+            if (useFalloff) {
+                double new_r = std::pow(r_norm, falloffPower);
                 if (r_norm > 1e-6) {
                     double scale = new_r / r_norm;
                     u *= scale;
@@ -212,29 +930,21 @@ public:
 
             // 2. Squareness (Boundary Constraint)
             // 0 = Circle, 100 = Square
-            if (params.distType == 1) { // Grid: Masking
-                if (params.distributionSquareness < 100) {
-                     double absCos = std::abs(std::cos(theta));
-                     double absSin = std::abs(std::sin(theta));
-                     double maxR_sq = (absCos > absSin) ? (1.0/absCos) : (1.0/absSin);
-                     if (std::isinf(maxR_sq)) maxR_sq = 1.0;
-
-                     // Interpolate boundary: 0->1.0, 100->maxR_sq
-                     double limit = 1.0 + (params.distributionSquareness / 100.0) * (maxR_sq - 1.0);
-                     
-                     if (r_norm > limit) continue; // Discard point
+            if (useSquareness) {
+                double absCos = std::abs(std::cos(theta));
+                double absSin = std::abs(std::sin(theta));
+                double maxR_sq = (absCos > absSin) ? (1.0/absCos) : (1.0/absSin);
+                if (std::isinf(maxR_sq)) maxR_sq = 1.0;
+
+                // Interpolate boundary: 0->1.0, 100->maxR_sq
+                double limit = 1.0 + squareness * (maxR_sq - 1.0);
+
+                if (dist == DistGrid) { // Grid: Masking
+                    if (r_norm > limit) continue; // Discard point
+                } else { // Random/Spiral: Stretching
+                    u *= limit;
+                    v *= limit;
                 }
-            } else { // Random/Spiral: Stretching
-                 if (params.distributionSquareness > 0) {
-                     double absCos = std::abs(std::cos(theta));
-                     double absSin = std::abs(std::sin(theta));
-                     double maxR_sq = (absCos > absSin) ? (1.0/absCos) : (1.0/absSin);
-                     if (std::isinf(maxR_sq)) maxR_sq = 1.0;
-                     
-                     double scaleF = 1.0 + (params.distributionSquareness / 100.0) * (maxR_sq - 1.0);
-                     u *= scaleF;
-                     v *= scaleF;
-                 }
             }
 
             u *= maxRadius;
@@ -243,125 +953,376 @@ public:
             v *= roundnessFactor;
             double xRot = u * cosA - v * sinA;
             double yRot = u * sinA + v * cosA;
-            double finalX = centerX + xRot;
-            double finalY = centerY + yRot;
-
-            // Use painter opacity to control transparency for both Shapes and Images
-            painter.setOpacity(alpha / 255.0);
-            QColor color(0, 0, 0, 255); 
-            painter.setBrush(color);
-            painter.setPen(Qt::NoPen);
-
-            // Apply Particle Transform
-            painter.save();
-            painter.translate(finalX, finalY);
 
             // Rotation
             double pAngle = params.particleAngle;
             if (params.particleAngleJitter > 0) {
-                 double jitterRange = 360.0 * (params.particleAngleJitter / 100.0);
-                 pAngle += (rng->generateDouble() - 0.5) * jitterRange; 
+                 pAngle += (rng->generateDouble() - 0.5) * angleJitterRange;
+            }
+
+            particles.push_back({(float)(centerX + xRot), (float)(centerY + yRot), (float)pAngle, s, alpha, i});
+        }
+    }
+
+    template <int Flags>
+    static void rasterParticles(const RasterContext& ctx, const std::vector<Particle>& particles) {
+        // Constant for specializations, so the branches below fold away
+        constexpr bool generic = Flags == kGenericKernel;
+        const Parameters& params = *ctx.params;
+        const int flags = generic ? rasterFlags(params) : Flags;
+        const int kind = flags >> 3;
+        const bool polygon = (flags & kPolygon) != 0;
+        const bool edgeModulation = (flags & kEdgeModulation) != 0;
+        const bool phaseWarp = (flags & kPhaseWarp) != 0;
+
+        QPainter& painter = *ctx.painter;
+        const double n = ctx.polygonSides;
+        const double an = polygon ? 2 * M_PI / n : 0.0;
+        const double polygonApothem = polygon ? std::cos(M_PI / n) : 1.0;
+        const double warpStrength = params.shapeWarpAmp / 50.0; // Scale to reasonable range (0.0 - 2.0 radians)
+        const double ampFactor = params.shapeEdgeAmp / 100.0;
+
+        // Unwarped polygons start on a corner so every corner gets a vertex
+        const double startAngle = polygon ? -ctx.rotationOffset : 0.0;
+
+        SaturationMask* saturation = ctx.saturation;
+        qint64 skipped = 0;
+        qint64 vertices = 0;
+        auto clipRect = [&](double x, double y, double reach, int& x0, int& y0, int& x1, int& y1) {
+            x0 = std::max(0, (int)std::floor(x - reach));
+            y0 = std::max(0, (int)std::floor(y - reach));
+            x1 = std::min(ctx.width - 1, (int)std::ceil(x + reach));
+            y1 = std::min(ctx.height - 1, (int)std::ceil(y + reach));
+            return x0 <= x1 && y0 <= y1;
+        };
+
+        // Expression outlines: warped t, particle index and radius per step
+        std::vector<float> exprT, exprIndex, exprR;
+
+        RasterKernels::SplatBatch splats;
+        auto flushSplats = [&]() {
+            if (ctx.transmittance16) RasterKernels::splat<uint16_t>(ctx.bits, ctx.stride, ctx.width, ctx.height, splats);
+            else RasterKernels::splat<uint8_t>(ctx.bits, ctx.stride, ctx.width, ctx.height, splats);
+            splats.count = 0;
+        };
+
+        for (const Particle& p : particles) {
+            const int s = p.size;
+            const double radius = s / 2.0;
+
+            // Nothing under a particle can change once all of its tiles are fully
+            // inked. Splats cost about as much as the check, so they are neither
+            // tested nor marked; that only delays when a tile is seen as saturated.
+            if (saturation && s > kSplatMaxSize) {
+                int x0, y0, x1, y1;
+                if (!clipRect(p.x, p.y, particleReach(params, s), x0, y0, x1, y1)) continue; // Off the buffer
+                if (saturation->covered(x0, y0, x1, y1)) {
+                    ++skipped;
+                    continue;
+                }
+                saturation->touch(x0, y0, x1, y1);
+            }
+
+            // Sub-pixel fast path: shape and rotation are invisible at this size
+            if (s <= kSplatMaxSize) {
+                int k = splats.count;
+                splats.x[k] = p.x;
+                splats.y[k] = p.y;
+                splats.area[k] = (float)(s * s * ctx.shapeFill * ctx.pRound);
+                splats.opacity[k] = p.alpha / 255.0f;
+                if (++splats.count == RasterKernels::kSplatBatch) flushSplats();
+                continue;
             }
-            painter.rotate(pAngle);
-
-            // Roundness (Scale Y)
-            double pRound = params.particleRoundness / 100.0;
-            if (pRound < 0.01) pRound = 0.01;
-            painter.scale(1.0, pRound); 
-
-            // Shape Generation (Draw at 0,0)
-            if (params.shapeId == 4) {
-                 // Wavetable Image
-                 // Draw centered at 0,0
-                 double offset = s / 2.0;
-                 // Draw the pre-generated image scaled to current particle size
-                 painter.drawImage(QRectF(-offset, -offset, s, s), wavetableImage);
-            } else if (params.shapeId == 0 && params.shapeEdgeFreq == 0) {
+
+            // Wavetable and image: affine blit from the mip chain straight into the coverage buffer
+            if (kind == ShapeStamp) {
+                if (ctx.transmittance16) {
+                    StampBlitter::blit<uint16_t>(ctx.bits, ctx.stride, ctx.width, ctx.height,
+                                                 *ctx.stamp, p.x, p.y, s, p.angle, ctx.pRound, p.alpha / 255.0);
+                } else {
+                    StampBlitter::blit<uint8_t>(ctx.bits, ctx.stride, ctx.width, ctx.height,
+                                                *ctx.stamp, p.x, p.y, s, p.angle, ctx.pRound, p.alpha / 255.0);
+                }
+                continue;
+            }
+
+            // Use painter opacity to control transparency for Shapes
+            painter.setOpacity(p.alpha / 255.0);
+
+            // Particle Transform: translate, rotate, then Roundness (Scale Y).
+            // Set directly instead of save()/restore(), which allocate per call.
+            double pAngle = p.angle * M_PI / 180.0;
+            double cosP = std::cos(pAngle);
+            double sinP = std::sin(pAngle);
+            double m21 = -sinP * ctx.pRound;
+            double m22 = cosP * ctx.pRound;
+
+            // Shape Generation
+            if (kind == ShapeEllipse) {
                 // Optimization for simple circle
+                painter.setTransform(QTransform(cosP, sinP, m21, m22, p.x, p.y));
                 painter.drawEllipse(QPointF(0, 0), radius, radius);
-            } else {
-                QPainterPath path;
-                int steps = 30 + std::min(s, 100); // Dynamic resolution
-                if (params.shapeEdgeFreq > 0) steps = std::max(steps, params.shapeEdgeFreq * 4); // Increase resolution for high freq
-                
-                // Determine Polygon Properties
-                double n = 0; // 0 means circle
-                double rotationOffset = 0;
-                
-                if (params.shapeId == 1) { // Triangle
-                    n = 3.0;
-                    rotationOffset = M_PI / 6.0; // Rotate to point up
-                } else if (params.shapeId == 2) { // Square
-                    n = 4.0;
-                    rotationOffset = M_PI / 4.0; // Rotate to align with axes
-                } else if (params.shapeId == 3) { // Polygon
-                    n = (double)params.polygonSides;
-                    rotationOffset = -M_PI / 2.0; // Usually start at top
-                    if (n < 3) n = 3;
+            } else if (ctx.radiusExpression) {
+                // Every step's radius in one batched evaluation
+                const int steps = ctx.outlineSteps(radius);
+                exprT.resize(steps + 1);
+                exprIndex.assign(steps + 1, (float)p.index);
+                exprR.resize(steps + 1);
+                for (int j = 0; j <= steps; ++j) {
+                    double t = (double)j / steps * 2 * M_PI;
+                    exprT[j] = (float)(phaseWarp ? t + std::sin(t * params.shapeWarpFreq) * warpStrength : t);
                 }
+                const float* inputs[] = {exprT.data(), exprIndex.data()};
+                ctx.radiusExpression->evaluate(inputs, exprR.data(), steps + 1);
 
+                // Plotted at the original t, like the built-in shapes
+                QPointF* outline = ctx.arena->vertices(steps + 1);
                 for (int j = 0; j <= steps; ++j) {
                     double t = (double)j / steps * 2 * M_PI;
-                    
-                    // Apply Phase Warp (Distortion)
-                    double t_warped = t;
-                    if (params.shapeWarpAmp > 0 && params.shapeWarpFreq > 0) {
-                        // sin(t * freq) creates a periodic shift in angle
-                        // Amp controls how strong the shift is
-                        double warp = std::sin(t * params.shapeWarpFreq);
-                        double warpStrength = params.shapeWarpAmp / 50.0; // Scale to reasonable range (0.0 - 2.0 radians)
-                        t_warped += warp * warpStrength;
-                    }
+                    double r = radius * expressionRadius(exprR[j]);
+                    double px = r * std::cos(t);
+                    double py = r * std::sin(t);
+                    outline[j] = QPointF(p.x + px * cosP + py * m21, p.y + px * sinP + py * m22);
+                }
+                vertices += steps + 1;
+                painter.drawPolygon(outline, steps + 1);
+            } else {
+                const int steps = ctx.outlineSteps(radius); // Error-bounded resolution
+                double phase = p.index * 13.5;
+                // Room for one inserted corner per step
+                QPointF* outline = ctx.arena->vertices(2 * steps + 1);
+                int count = 0;
+                int prevSector = 0;
+                double prevT = startAngle;
+
+                // Apply Phase Warp (Distortion)
+                // sin(t * freq) creates a periodic shift in angle, Amp controls how strong the shift is
+                auto warp = [&](double t) {
+                    return phaseWarp ? t + std::sin(t * params.shapeWarpFreq) * warpStrength : t;
+                };
+                // Vertices go out in canvas space, the painter keeps an identity transform
+                auto plot = [&](double t, double r) {
+                    double px = r * std::cos(t);
+                    double py = r * std::sin(t);
+                    return QPointF(p.x + px * cosP + py * m21, p.y + px * sinP + py * m22);
+                };
+
+                for (int j = 0; j <= steps; ++j) {
+                    double t = startAngle + (double)j / steps * 2 * M_PI;
+                    double t_warped = warp(t);
 
                     // Base Shape Radius
                     double currentR = radius;
-                    
-                    if (n > 0) {
+
+                    if (polygon) {
                          // Regular Polygon Polar Formula
                          // Use warped t for "Liquify" effect on the polygon itself
-                         double an = 2 * M_PI / n;
-                         double t_rot = t_warped + rotationOffset; 
-                         
+                         double t_rot = t_warped + ctx.rotationOffset;
+
+                         // Warped corners fall between samples: bisect for the
+                         // crossing and insert the exact corner, where the
+                         // polygon factor is 1
+                         if (phaseWarp) {
+                             int sector = (int)std::floor(t_rot / an);
+                             if (j > 0 && sector != prevSector) {
+                                 double corner = std::max(sector, prevSector) * an - ctx.rotationOffset;
+                                 double lo = prevT, hi = t;
+                                 bool rising = sector > prevSector;
+                                 for (int k = 0; k < 8; ++k) {
+                                     double mid = 0.5 * (lo + hi);
+                                     if ((warp(mid) < corner) == rising) lo = mid;
+                                     else hi = mid;
+                                 }
+                                 double cornerR = radius;
+                                 if (edgeModulation) cornerR *= 1.0 + std::sin(corner * params.shapeEdgeFreq + phase) * ampFactor;
+                                 outline[count++] = plot(0.5 * (lo + hi), cornerR);
+                             }
+                             prevSector = sector;
+                             prevT = t;
+                         }
+
                          // We want fmod(t_rot, an) - an/2
                          double he = std::fmod(t_rot, an);
                          if (he < 0) he += an;
                          he -= an / 2.0;
-                         
-                         double scale = std::cos(M_PI / n) / std::cos(he);
-                         currentR *= scale; 
+
+                         currentR *= polygonApothem / std::cos(he);
                     }
 
                     // Edge Modulation (FM Synthesis equivalent)
-                    if (params.shapeEdgeFreq > 0 && params.shapeEdgeAmp > 0) {
+                    if (edgeModulation) {
                         // Use warped t for the wave too, creating non-uniform spikes
-                        double wave = std::sin(t_warped * params.shapeEdgeFreq);
-                        double phase = i * 13.5; 
-                        wave = std::sin(t_warped * params.shapeEdgeFreq + phase);
-                        
-                        double ampFactor = params.shapeEdgeAmp / 100.0;
+                        double wave = std::sin(t_warped * params.shapeEdgeFreq + phase);
                         currentR *= (1.0 + wave * ampFactor);
                     }
 
-                    double px = currentR * std::cos(t); // Keep original t for position to maintain continuity? 
-                    // No, if we want the shape to actually warp, we should probably use t for position 
-                    // BUT polar coords: (r, theta). If we change r based on t_warped, but plot at t, we get radial distortion.
-                    // If we plot at t_warped, we get angular bunching.
-                    // Let's stick to plotting at 't' but calculating radius based on 't_warped'.
-                    // This creates the "Twist" effect on the shape's features without breaking the circle loop.
-                    
-                    double py = currentR * std::sin(t);
-                    
-                    if (j == 0) path.moveTo(px, py);
-                    else path.lineTo(px, py);
+                    // Plot at the original t but with the radius from t_warped:
+                    // this twists the shape's features without breaking the loop
+                    outline[count++] = plot(t, currentR);
                 }
-                path.closeSubpath();
-                
-                // No translation needed, we are at 0,0 local space
-                painter.drawPath(path);
+                vertices += count;
+
+                // Same odd-even fill the closed QPainterPath used
+                painter.drawPolygon(outline, count);
             }
-            painter.restore();
         }
+        flushSplats();
 
-        return image;
+        if (ctx.stats) {
+            ctx.stats->particles += (qint64)particles.size();
+            ctx.stats->skipped += skipped;
+            ctx.stats->vertices += vertices;
+        }
+    }
+
+    static QImage makeWavetable(const Parameters& params) {
+        int size = std::ceil(maxParticleSize(params));
+        if (size < 1) size = 1;
+        // Power-of-two base so every mip level is an exact 2x2 reduction
+        int baseSize = 1;
+        while (baseSize < size) baseSize *= 2;
+        size = baseSize;
+
+        QImage wavetableImage(size, size, QImage::Format_ARGB32);
+        wavetableImage.fill(Qt::transparent);
+
+        // Wavetable Generation (FM Synthesis Style)
+        // Z = sin(u * fx + FM * sin(v * fy + phase))
+        // Cutoff at threshold
+
+        double freqX = std::max(1.0, (double)params.shapeEdgeFreq);
+        double freqY = std::max(1.0, (double)params.shapeWarpFreq); // Modulator Freq
+        double fmAmount = params.shapeEdgeAmp / 20.0; // FM Index
+        double phaseY = params.shapeWarpAmp / 100.0 * 2.0 * M_PI;
+        double threshold = (params.waveThreshold / 50.0) - 1.0; // Map 0..100 to -1..1
+
+        // Invert threshold logic: User likely wants "Amount of shape", so 100% means full square, 0% means nothing.
+        // Or "Threshold" means Cutoff Level.
+        // User said "Keep high parts". So High Threshold = Less pixels.
+        // Let's stick to "Threshold". 0 = Keep Everything (Full Square), 100 = Keep Nothing (Peaks only).
+        // So T = map(val, 0, 100, -1.0, 1.0).
+
+        // A user wave is evaluated a row at a time
+        const ShapeExpression* expression = params.waveExpression.get();
+        std::vector<float> rowU(expression ? size : 0), rowV(expression ? size : 0), rowZ(expression ? size : 0);
+        for (int x = 0; x < (int)rowU.size(); ++x) rowU[x] = (float)((double)x / size * 2.0 * M_PI - M_PI);
+
+        for (int y = 0; y < size; ++y) {
+            QRgb* scanLine = (QRgb*)wavetableImage.scanLine(y);
+            double v = (double)y / size * 2.0 * M_PI - M_PI; // -PI to PI
+            if (expression) {
+                std::fill(rowV.begin(), rowV.end(), (float)v);
+                const float* inputs[] = {rowU.data(), rowV.data()};
+                expression->evaluate(inputs, rowZ.data(), size);
+            }
+
+            for (int x = 0; x < size; ++x) {
+                double u = (double)x / size * 2.0 * M_PI - M_PI; // -PI to PI
+
+                // FM Formula
+                // Modulator
+                double mod = std::sin(v * freqY + phaseY);
+
+                // To make it more interesting, let's mix X and Y?
+                // The above is strictly horizontal waves modulated vertically.
+                // If we want "Cells", we need interference.
+                // Let's add a vertical carrier component too?
+                // signal = (sin(...) + sin(v * freqY)) / 2
+
+                // User asked for "Wavetable Cross Section".
+                // Let's try: Z = sin(u*fx) * sin(v*fy). This makes Grid.
+                // With FM: Z = sin(u*fx + mod) * sin(v*fy + mod) ?
+
+                // Let's go with the "Interference" model (Sum):
+                // Z = (sin(u * fx + fm * mod) + sin(v * fy + phaseY)) / 2.0
+
+                double z = expression ? rowZ[x] : (std::sin(u * freqX + fmAmount * mod) + std::sin(v * freqY + phaseY)) / 2.0;
+
+                if (z > threshold) {
+                    // Anti-aliasing
+                    double edge = std::min(1.0, (z - threshold) * 10.0); // Soft edge
+                    int alpha = (int)(edge * 255);
+                    scanLine[x] = qRgba(0, 0, 0, alpha);
+                } else {
+                    scanLine[x] = qRgba(0, 0, 0, 0);
+                }
+            }
+        }
+        return wavetableImage;
+    }
+
+    // Fraction of the image that is ink, used to give splatted particles the
+    // same average coverage as drawn ones
+    static double averageAlpha(const QImage& image) {
+        qint64 sum = 0;
+        for (int y = 0; y < image.height(); ++y) {
+            const QRgb* line = (const QRgb*)image.constScanLine(y);
+            for (int x = 0; x < image.width(); ++x) sum += qAlpha(line[x]);
+        }
+        return sum / (255.0 * image.width() * image.height());
+    }
+
+    static std::vector<QPointF> poissonDiskFill(double radius, QRandomGenerator* rng) {
+        const int candidates = 30;
+        double cellSize = radius / std::sqrt(2.0);
+        int gridSide = std::max(1, (int)std::ceil(2.0 / cellSize));
+        std::vector<int> grid(gridSide * gridSide, -1);
+        std::vector<QPointF> points;
+        std::vector<int> active;
+
+        auto cellOf = [&](double x) {
+            return std::clamp((int)((x + 1.0) / cellSize), 0, gridSide - 1);
+        };
+        auto insert = [&](const QPointF& p) {
+            grid[cellOf(p.y()) * gridSide + cellOf(p.x())] = (int)points.size();
+            active.push_back((int)points.size());
+            points.push_back(p);
+        };
+
+        double r0 = std::sqrt(rng->generateDouble());
+        double t0 = rng->generateDouble() * 2 * M_PI;
+        insert(QPointF(r0 * std::cos(t0), r0 * std::sin(t0)));
+
+        double radiusSq = radius * radius;
+        while (!active.empty()) {
+            int a = rng->bounded((int)active.size());
+            QPointF origin = points[active[a]];
+            bool found = false;
+
+            for (int k = 0; k < candidates && !found; ++k) {
+                // Candidate in the annulus [r, 2r] around the active point
+                double angle = rng->generateDouble() * 2 * M_PI;
+                double dist = radius * (1.0 + rng->generateDouble());
+                double x = origin.x() + dist * std::cos(angle);
+                double y = origin.y() + dist * std::sin(angle);
+                if (x * x + y * y > 1.0) continue;
+
+                int cx = cellOf(x);
+                int cy = cellOf(y);
+                bool clear = true;
+                for (int gy = std::max(0, cy - 2); gy <= std::min(gridSide - 1, cy + 2) && clear; ++gy) {
+                    for (int gx = std::max(0, cx - 2); gx <= std::min(gridSide - 1, cx + 2); ++gx) {
+                        int q = grid[gy * gridSide + gx];
+                        if (q < 0) continue;
+                        double dx = points[q].x() - x;
+                        double dy = points[q].y() - y;
+                        if (dx * dx + dy * dy < radiusSq) {
+                            clear = false;
+                            break;
+                        }
+                    }
+                }
+                if (clear) {
+                    insert(QPointF(x, y));
+                    found = true;
+                }
+            }
+
+            if (!found) {
+                active[a] = active.back();
+                active.pop_back();
+            }
+        }
+        return points;
     }
 };
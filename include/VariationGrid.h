@@ -0,0 +1,111 @@
+#pragma once
+
+#include <QImage>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <thread>
+#include <vector>
+#include "BrushLayers.h"
+#include "TextureGenerator.h"
+
+// Grid of variations of one layer for browsing: columns step through seeds
+// and rows either continue the seeds or sweep one parameter over a range.
+// Every cell has a fixed seed, so a cell renders the same brush at any size
+// and can be adopted as is.
+class VariationGrid {
+public:
+    static constexpr int kThumbnailSize = 128;
+
+    using Field = int TextureGenerator::Parameters::*;
+
+    // Row sweep; a null field makes every cell a new seed
+    struct Sweep {
+        Field field = nullptr;
+        int from = 0;
+        int to = 0;
+    };
+
+    struct Cell {
+        TextureGenerator::Parameters params;
+        int value = 0; // Swept field's value
+    };
+
+    // Seeds run firstSeed, firstSeed + 1, ... and wrap to stay in [1, maxSeed]
+    VariationGrid(const TextureGenerator::Parameters& base, int rows, int columns, quint32 firstSeed,
+                  const Sweep& sweep, quint32 maxSeed = 0xffffffffu)
+        : m_rows(std::max(1, rows)), m_columns(std::max(1, columns)) {
+        firstSeed = std::max(1u, firstSeed);
+        for (int r = 0; r < m_rows; ++r) {
+            for (int c = 0; c < m_columns; ++c) {
+                Cell cell;
+                cell.params = base;
+                quint32 step = sweep.field ? c : r * m_columns + c;
+                cell.params.seed = 1 + (quint32)(((quint64)firstSeed - 1 + step) % maxSeed);
+                if (sweep.field) {
+                    double t = m_rows > 1 ? (double)r / (m_rows - 1) : 0.0;
+                    cell.params.*sweep.field = (int)std::lround(sweep.from + (sweep.to - sweep.from) * t);
+                    cell.value = cell.params.*sweep.field;
+                }
+                m_cells.push_back(cell);
+            }
+        }
+    }
+
+    int rows() const { return m_rows; }
+    int columns() const { return m_columns; }
+    int count() const { return (int)m_cells.size(); }
+    const Cell& cell(int index) const { return m_cells[index]; }
+
+    // Alpha8 renders of cells [first, first + count) on a canvas of the given
+    // size, in parallel. Each is the whole brush with layer layerIndex
+    // replaced by the cell; the other layers are rendered once and shared.
+    std::vector<QImage> render(const BrushLayers& layers, int layerIndex, int first, int count, int size,
+                               int threads = 0) const {
+        std::vector<QImage> shared(layers.count());
+        for (int i = 0; i < layers.count(); ++i) {
+            const BrushLayers::Layer& layer = layers.layer(i);
+            if (i == layerIndex || !layer.visible) continue;
+            TextureGenerator::Parameters params = BrushLayers::resized(layer.params, size);
+            shared[i] = TextureGenerator::renderCoverage(params, TextureGenerator::place(params));
+        }
+
+        std::vector<QImage> images(std::max(0, count));
+        parallelFor(count, threads, [&](int k) {
+            QImage result(size, size, QImage::Format_Alpha8);
+            result.fill(0);
+            for (int i = 0; i < layers.count(); ++i) {
+                const BrushLayers::Layer& layer = layers.layer(i);
+                if (!layer.visible) continue;
+                if (i != layerIndex) {
+                    BrushLayers::blend(result, shared[i], layer);
+                    continue;
+                }
+                TextureGenerator::Parameters params = BrushLayers::resized(m_cells[first + k].params, size);
+                BrushLayers::blend(result, TextureGenerator::renderCoverage(params, TextureGenerator::place(params)), layer);
+            }
+            images[k] = std::move(result);
+        });
+        return images;
+    }
+
+private:
+    // Runs fn(0) .. fn(count - 1) on a pool of threads
+    template <typename Fn>
+    static void parallelFor(int count, int threads, const Fn& fn) {
+        if (threads <= 0) threads = (int)std::max(1u, std::thread::hardware_concurrency());
+        threads = std::min(threads, count);
+        std::atomic<int> next{0};
+        auto worker = [&]() {
+            for (int k = next++; k < count; k = next++) fn(k);
+        };
+        std::vector<std::thread> pool;
+        for (int i = 1; i < threads; ++i) pool.emplace_back(worker);
+        worker();
+        for (std::thread& thread : pool) thread.join();
+    }
+
+    int m_rows;
+    int m_columns;
+    std::vector<Cell> m_cells;
+};
@@ -0,0 +1,331 @@
+#include "AbrReader.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+
+// Largest brush side accepted; anything bigger is a misread header
+constexpr int kMaxSide = 30000;
+
+// Big-endian reads over the mapped bytes. Reading past the end returns zeros
+// and clears ok(), so a header is parsed first and checked once.
+class Cursor {
+public:
+    Cursor(const uchar* data, qint64 size, qint64 pos) : m_data(data), m_size(size), m_pos(pos) {}
+
+    bool ok() const { return m_ok; }
+    qint64 pos() const { return m_pos; }
+
+    void seek(qint64 pos) {
+        if (pos < 0 || pos > m_size) m_ok = false;
+        else m_pos = pos;
+    }
+    void skip(qint64 bytes) { seek(m_pos + bytes); }
+
+    const uchar* take(qint64 bytes) {
+        if (!m_ok || bytes < 0 || bytes > m_size - m_pos) {
+            m_ok = false;
+            return nullptr;
+        }
+        const uchar* p = m_data + m_pos;
+        m_pos += bytes;
+        return p;
+    }
+
+    quint8 u8() {
+        const uchar* p = take(1);
+        return p ? p[0] : 0;
+    }
+    quint16 u16() {
+        const uchar* p = take(2);
+        return p ? (quint16)(p[0] << 8 | p[1]) : 0;
+    }
+    quint32 u32() {
+        const uchar* p = take(4);
+        return p ? (quint32)p[0] << 24 | (quint32)p[1] << 16 | (quint32)p[2] << 8 | p[3] : 0;
+    }
+    qint16 s16() { return (qint16)u16(); }
+    qint32 s32() { return (qint32)u32(); }
+
+private:
+    const uchar* m_data;
+    qint64 m_size;
+    qint64 m_pos;
+    bool m_ok = true;
+};
+
+// PackBits-decodes until length bytes are out; false if the input runs out
+// first. The inverse of encodePackBits in AbrWriter.cpp.
+bool unpackBits(const uchar*& in, const uchar* end, uchar* out, qsizetype length) {
+    qsizetype x = 0;
+    while (x < length) {
+        if (in >= end) return false;
+        qint8 n = (qint8)*in++;
+        if (n >= 0) {
+            qsizetype count = n + 1;
+            if (end - in < count) return false;
+            std::memcpy(out + x, in, std::min(count, length - x));
+            in += count;
+            x += count;
+        } else if (n != -128) { // -128 is a no-op
+            if (in >= end) return false;
+            qsizetype count = 1 - n;
+            std::memset(out + x, *in++, std::min(count, length - x));
+            x += count;
+        }
+    }
+    return true;
+}
+
+QRect boundsFrom(int top, int left, int bottom, int right) {
+    return QRect(left, top, right - left, bottom - top);
+}
+
+} // namespace
+
+AbrReader::~AbrReader() {
+    close();
+}
+
+bool AbrReader::open(const QString& filename) {
+    close();
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::ReadOnly)) return fail(m_file.errorString());
+
+    // Mapping costs nothing up front; pages are read as brushes touch them
+    m_size = m_file.size();
+    m_data = m_size > 0 ? m_file.map(0, m_size) : nullptr;
+    if (!m_data) return fail(m_size > 0 ? m_file.errorString() : QString("Empty file"));
+    return index();
+}
+
+bool AbrReader::open(const QByteArray& data) {
+    close();
+    m_buffer = data;
+    m_size = m_buffer.size();
+    m_data = m_size > 0 ? reinterpret_cast<const uchar*>(m_buffer.constData()) : nullptr;
+    if (!m_data) return fail("Empty data");
+    return index();
+}
+
+void AbrReader::close() {
+    if (m_file.isOpen()) {
+        if (m_data) m_file.unmap(const_cast<uchar*>(m_data));
+        m_file.close();
+    }
+    m_buffer.clear();
+    m_data = nullptr;
+    m_size = 0;
+    m_version = 0;
+    m_error.clear();
+    m_entries.clear();
+}
+
+bool AbrReader::fail(const QString& error) {
+    close();
+    m_error = error;
+    return false;
+}
+
+bool AbrReader::index() {
+    Cursor in(m_data, m_size, 0);
+    m_version = in.s16();
+    if (!in.ok()) return fail("Not an ABR file");
+
+    bool indexed = false;
+    if (m_version == 1 || m_version == 2) {
+        // AbrWriter's files also say version 1 but carry a subversion word
+        // before the count, so they are tried first and must parse exactly
+        indexed = (m_version == 1 && indexClassic(true)) || indexClassic(false);
+    } else if (m_version >= 6 && m_version <= 10) {
+        indexed = indexSamples();
+    } else {
+        return fail(QString("Unsupported ABR version %1").arg(m_version));
+    }
+    if (!indexed) return fail("Corrupt or unsupported ABR file");
+    return true;
+}
+
+// Version 1 and 2: a brush count, then brushes of a type and a size
+bool AbrReader::indexClassic(bool exported) {
+    m_entries.clear();
+    Cursor in(m_data, m_size, 2);
+    if (exported && in.u16() != 1) return false; // Subversion
+    int count = in.s16();
+    if (!in.ok() || count < 0) return false;
+
+    for (int i = 0; i < count; ++i) {
+        int type = in.s16();
+        qint64 end = in.u32();
+        end += in.pos();
+        if (!in.ok() || end > m_size) return false;
+
+        if (type == 2) { // Sampled
+            Entry entry;
+            entry.end = end;
+            if (exported) {
+                entry.info.spacing = in.s16();
+                int nameLength = in.u8();
+                const uchar* name = in.take(nameLength);
+                if (name) entry.info.name = QString::fromLatin1(reinterpret_cast<const char*>(name), nameLength);
+                in.skip(1 + 2); // Anti-aliasing, interest
+                int top = in.s16(), left = in.s16(), bottom = in.s16(), right = in.s16();
+                entry.info.bounds = boundsFrom(top, left, bottom, right);
+                entry.info.depth = in.s16();
+                entry.compression = Compression::Packed;
+            } else {
+                in.skip(4); // Misc
+                entry.info.spacing = in.s16();
+                if (m_version == 2) {
+                    // UCS-2 name with its terminating null
+                    quint32 length = in.u32();
+                    const uchar* name = in.take(2 * (qint64)length);
+                    for (quint32 c = 0; name && c < length; ++c) {
+                        QChar ch(name[2 * c] << 8 | name[2 * c + 1]);
+                        if (ch.isNull()) break;
+                        entry.info.name.append(ch);
+                    }
+                }
+                in.skip(1 + 8); // Anti-aliasing, 16-bit bounds
+                int top = in.s32(), left = in.s32(), bottom = in.s32(), right = in.s32();
+                entry.info.bounds = boundsFrom(top, left, bottom, right);
+                entry.info.depth = in.s16();
+                entry.compression = in.u8() ? Compression::RowCounts : Compression::Raw;
+            }
+            entry.data = in.pos();
+            if (!in.ok() || !valid(entry) || (exported && entry.info.depth != 8)) return false;
+            m_entries.push_back(entry);
+        } else if (exported || type != 1) { // 1 is a computed brush, which has no samples
+            return false;
+        }
+        in.seek(end);
+    }
+    // An export ends right after its last brush, which tells it apart from a
+    // version 1 file that happens to start the same way
+    return in.ok() && (!exported || in.pos() == m_size);
+}
+
+// Version 6+: tagged 8BIM sections; the sampled brushes are in "samp"
+bool AbrReader::indexSamples() {
+    m_entries.clear();
+    Cursor in(m_data, m_size, 2);
+    int subversion = in.u16();
+    if (subversion != 1 && subversion != 2) return false;
+
+    qint64 sectionEnd = 0;
+    for (;;) {
+        const uchar* tag = in.take(4);
+        const uchar* key = in.take(4);
+        qint64 size = in.u32();
+        if (!in.ok() || std::memcmp(tag, "8BIM", 4) != 0) return false;
+        if (std::memcmp(key, "samp", 4) == 0) {
+            sectionEnd = in.pos() + size;
+            break;
+        }
+        in.skip(size); // Patterns, descriptor, ...
+    }
+    if (sectionEnd > m_size) return false;
+
+    while (in.ok() && in.pos() < sectionEnd) {
+        qint64 size = in.u32();
+        Entry entry;
+        entry.end = in.pos() + size;
+        qint64 next = std::min(sectionEnd, in.pos() + ((size + 3) & ~qint64(3))); // Padded to 4 bytes
+        if (!in.ok() || entry.end > sectionEnd) return false;
+
+        in.skip(subversion == 1 ? 47 : 301); // Sample ID and fields we do not use
+        int top = in.s32(), left = in.s32(), bottom = in.s32(), right = in.s32();
+        entry.info.bounds = boundsFrom(top, left, bottom, right);
+        entry.info.depth = in.s16();
+        entry.compression = in.u8() ? Compression::RowCounts : Compression::Raw;
+        entry.data = in.pos();
+        if (!in.ok() || !valid(entry)) return false;
+        m_entries.push_back(entry);
+        in.seek(next);
+    }
+    return in.ok();
+}
+
+// Header sanity and the minimum data the brush needs, without decoding it
+bool AbrReader::valid(const Entry& entry) const {
+    const QRect& bounds = entry.info.bounds;
+    if (bounds.width() <= 0 || bounds.height() <= 0 || bounds.width() > kMaxSide || bounds.height() > kMaxSide) return false;
+    if (entry.info.depth != 8 && entry.info.depth != 16) return false;
+    qint64 available = entry.end - entry.data;
+    switch (entry.compression) {
+    case Compression::Raw:
+        return available >= (qint64)bounds.width() * bounds.height() * (entry.info.depth / 8);
+    case Compression::RowCounts:
+        return available >= 2 * (qint64)bounds.height();
+    case Compression::Packed:
+        return available >= 2 * (qint64)bounds.height(); // At least one run per row
+    }
+    return false;
+}
+
+QImage AbrReader::image(int index) const {
+    if (index < 0 || index >= count()) return QImage();
+    const Entry& entry = m_entries[index];
+    const int width = entry.info.bounds.width();
+    const int height = entry.info.bounds.height();
+    const int bytes = entry.info.depth / 8;
+    const qsizetype rowBytes = (qsizetype)width * bytes;
+
+    QImage image(width, height, QImage::Format_Alpha8);
+    if (image.isNull()) return image;
+
+    // 16-bit samples are decoded into a row buffer and keep their high byte
+    std::vector<uchar> wide(bytes > 1 ? rowBytes : 0);
+    const uchar* in = m_data + entry.data;
+    const uchar* end = m_data + entry.end;
+    const uchar* counts = in;
+    if (entry.compression == Compression::RowCounts) in += 2 * (qsizetype)height;
+
+    for (int y = 0; y < height; ++y) {
+        uchar* out = bytes > 1 ? wide.data() : image.scanLine(y);
+        bool ok = false;
+        switch (entry.compression) {
+        case Compression::Raw:
+            ok = end - in >= rowBytes;
+            if (ok) std::memcpy(out, in, rowBytes);
+            in += ok ? rowBytes : 0;
+            break;
+        case Compression::RowCounts: {
+            qsizetype length = counts[2 * y] << 8 | counts[2 * y + 1];
+            if (end - in < length) break;
+            const uchar* rowEnd = in + length;
+            ok = unpackBits(in, rowEnd, out, rowBytes);
+            in = rowEnd;
+            break;
+        }
+        case Compression::Packed:
+            ok = unpackBits(in, end, out, rowBytes);
+            break;
+        }
+        if (!ok) return QImage();
+
+        if (bytes > 1) {
+            uchar* line = image.scanLine(y);
+            for (int x = 0; x < width; ++x) line[x] = wide[(qsizetype)x * bytes];
+        }
+    }
+    return image;
+}
+
+QImage AbrReader::loadTip(const QString& source) {
+    QString path = source;
+    int index = 0;
+    int hash = source.lastIndexOf('#');
+    bool numbered = false;
+    if (hash > 0) {
+        int n = source.mid(hash + 1).toInt(&numbered);
+        if (numbered && source.left(hash).endsWith(".abr", Qt::CaseInsensitive)) {
+            path = source.left(hash);
+            index = n;
+        }
+    }
+    if (!path.endsWith(".abr", Qt::CaseInsensitive)) return QImage(path);
+
+    AbrReader reader;
+    return reader.open(path) ? reader.image(index) : QImage();
+}
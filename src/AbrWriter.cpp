@@ -1,9 +1,11 @@
 #include "AbrWriter.h"
+#include "MemoryTracker.h"
 #include <QFile>
 #include <QDataStream>
 #include <QImage>
 #include <QBuffer>
 #include <QDebug>
+#include <algorithm>
 
 // Helper to write Pascal string (1 byte length + content)
 // In some versions, it might be padded. For V1/V2, we'll assume no padding or 2-byte align?
@@ -116,122 +118,162 @@ QByteArray encodePackBits(const QByteArray& data) {
 }
 
 bool AbrWriter::writeAbr(const QString& filename, const QImage& brushImage, const QString& brushName, int spacingPercent) {
-    QFile file(filename);
-    if (!file.open(QIODevice::WriteOnly)) {
+    return writeAbr(filename, QList<QImage>{brushImage}, QStringList{brushName}, spacingPercent);
+}
+
+bool AbrWriter::writeAbr(const QString& filename, const QList<QImage>& brushImages, const QStringList& brushNames, int spacingPercent) {
+    AbrStreamWriter writer;
+    if (!writer.open(filename, brushImages.size())) {
         return false;
     }
+    for (qsizetype i = 0; i < brushImages.size(); ++i) {
+        // Extract alpha channel to grayscale
+        // QImage::alphaChannel() is deprecated/removed in Qt 6. Use convertToFormat(QImage::Format_Alpha8).
+        // TextureGenerator produces ARGB32 with Black color and varying Alpha.
+        // So alpha channel is the correct data.
+        QImage alphaImg = brushImages[i].convertToFormat(QImage::Format_Alpha8);
+        TrackedBytes alphaBytes(MemoryTracker::Encode, alphaImg.sizeInBytes());
+        if (!writer.beginBrush(alphaImg.width(), alphaImg.height(), brushNames.value(i), spacingPercent)) {
+            writer.finish();
+            return false;
+        }
+        writer.writeRows(alphaImg.constBits(), alphaImg.bytesPerLine(), alphaImg.height());
+    }
+    return writer.finish();
+}
+
+QByteArray AbrWriter::abrData(const QImage& brushImage, const QString& brushName, int spacingPercent) {
+    QImage alphaImg = brushImage.convertToFormat(QImage::Format_Alpha8);
+    TrackedBytes encodeBytes(MemoryTracker::Encode, alphaImg.sizeInBytes());
+    QBuffer buffer;
+    buffer.open(QIODevice::WriteOnly);
+    AbrStreamWriter writer;
+    bool ok = writer.open(&buffer, 1) && writer.beginBrush(alphaImg.width(), alphaImg.height(), brushName, spacingPercent)
+        && writer.writeRows(alphaImg.constBits(), alphaImg.bytesPerLine(), alphaImg.height());
+    ok = writer.finish() && ok;
+    encodeBytes.set(alphaImg.sizeInBytes() + buffer.data().capacity());
+    return ok ? buffer.data() : QByteArray();
+}
+
+bool AbrStreamWriter::begin(const QString& filename, int width, int height, const QString& brushName, int spacingPercent) {
+    if (!open(filename, 1)) return false;
+    if (beginBrush(width, height, brushName, spacingPercent)) return true;
+    finish();
+    return false;
+}
 
-    QDataStream out(&file);
-    out.setByteOrder(QDataStream::BigEndian);
+bool AbrStreamWriter::open(const QString& filename, int brushCount) {
+    // The count is 16-bit in the V1 format
+    if (brushCount <= 0 || brushCount > 32767) return false;
+
+    m_file.setFileName(filename);
+    if (!m_file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return open(&m_file, brushCount);
+}
+
+bool AbrStreamWriter::open(QIODevice* device, int brushCount) {
+    m_device = device;
+    m_brushCount = brushCount;
+    m_brushesWritten = 0;
+    m_inBrush = false;
+
+    if (brushCount <= 0 || brushCount > 32767 || !device->isOpen()) return false;
+
+    m_out.setDevice(device);
+    m_out.setByteOrder(QDataStream::BigEndian);
 
     // 1. Header (V1)
-    out << (qint16)1; // Version 1
-    // Some specs say V1 has no subversion?
+    m_out << (qint16)1; // Version 1
     // GIMP abr.c: if version==1, read subversion.
-    // Let's write subversion 1.
-    out << (qint16)1; // Subversion
-    out << (qint16)1; // Count (1 brush)
+    m_out << (qint16)1; // Subversion
+    m_out << (qint16)brushCount; // Count
+
+    return m_out.status() == QDataStream::Ok;
+}
+
+bool AbrStreamWriter::beginBrush(int width, int height, const QString& brushName, int spacingPercent) {
+    if (m_inBrush && !endBrush()) return false;
+    if (m_brushesWritten >= m_brushCount) return false;
+
+    m_width = width;
+    m_height = height;
+    m_rowsWritten = 0;
+
+    // Bounds are 16-bit in the V1 format
+    if (width <= 0 || height <= 0 || width > 32767 || height > 32767) return false;
 
     // 2. Brush Data (Sampled Brush - Type 2)
-    
-    // Prepare data first to calculate size
-    QByteArray brushData;
-    QDataStream bOut(&brushData, QIODevice::WriteOnly);
-    bOut.setByteOrder(QDataStream::BigEndian);
+    m_out << (qint16)2; // Type = Sampled
+
+    // Size: Total bytes of the brush data, patched in endBrush() once the
+    // compressed rows have been written
+    m_sizePos = m_device->pos();
+    m_out << (qint32)0;
 
     // Misc fields
-    bOut << (qint16)spacingPercent; // Spacing (0-999)
-    
-    // Name (Pascal String)
-    // In V1, no padding? Let's assume no padding.
-    // Use helper
+    m_out << (qint16)spacingPercent; // Spacing (0-999)
+
+    // Name (Pascal String), no padding in V1
     QByteArray nameBytes = brushName.toLatin1();
     if (nameBytes.size() > 255) nameBytes.resize(255);
     quint8 nameLen = static_cast<quint8>(nameBytes.size());
-    bOut << nameLen;
-    if (nameLen > 0) bOut.writeRawData(nameBytes.constData(), nameLen);
-    
+    m_out << nameLen;
+    if (nameLen > 0) m_out.writeRawData(nameBytes.constData(), nameLen);
+
     // Anti-aliasing (1 byte)
-    bOut << (quint8)1; // True
+    m_out << (quint8)1; // True
 
     // Interest (2 bytes)
-    bOut << (qint16)0; 
+    m_out << (qint16)0;
 
     // Bounds (Top, Left, Bottom, Right) - 2 bytes each
-    // Relative to the image itself?
-    // Usually (0, 0, Height, Width)
-    // Ensure image is valid
-    QImage grayImg = brushImage.convertToFormat(QImage::Format_Grayscale8);
-    // Invert? Photoshop brushes: Black = opaque, White = transparent?
-    // Or Alpha?
-    // Usually ABR stores the alpha channel as grayscale.
-    // White (255) = Opaque, Black (0) = Transparent? 
-    // Or Black (0) = Opaque, White (255) = Transparent?
-    // GIMP says: "This is the opposite convention... if you want to import... invert them."
-    // Photoshop: Black (0) is ink?
-    // Wait, typical alpha mask: 255 = Opaque.
-    // But Photoshop brushes are often stored as "Ink Density".
-    // 0 = No Ink (Transparent), 255 = Max Ink (Black).
-    // Let's assume 255 = Opaque (Black ink), 0 = Transparent.
-    // If the QImage has alpha, we should extract alpha.
-    
-    // Extract alpha channel to grayscale
-    // QImage::alphaChannel() is deprecated/removed in Qt 6. Use convertToFormat(QImage::Format_Alpha8).
-    QImage alphaImg = brushImage.convertToFormat(QImage::Format_Alpha8);
-    // If original image is grayscale without alpha, use it directly?
-    // TextureGenerator produces ARGB32 with Black color and varying Alpha.
-    // So alpha channel is the correct data.
-    // 0 alpha -> Transparent. 255 alpha -> Opaque.
-    // This matches "Ink Density" if we treat it as such.
-    
-    qint16 top = 0;
-    qint16 left = 0;
-    qint16 bottom = static_cast<qint16>(alphaImg.height());
-    qint16 right = static_cast<qint16>(alphaImg.width());
-    
-    bOut << top << left << bottom << right;
+    m_out << (qint16)0 << (qint16)0 << (qint16)height << (qint16)width;
 
     // Depth (2 bytes)
-    bOut << (qint16)8; // 8-bit
-
-    // Image Data
-    // PackBits compression? Or Raw?
-    // Try Raw first?
-    // No, search results suggest PackBits.
-    // Let's assume V1/V2 supports RLE.
-    // Wait, does V1 support RLE?
-    // "Computed brush data... Sampled brush data varies..."
-    // I'll check if I can just write Raw.
-    // If I write Raw, size must be exactly H*W.
-    // If I write RLE, size is compressed size.
-    // The `Size` field (before Data) tells the parser how many bytes to read.
-    // So if I specify correct Size, the parser *might* try to detect compression?
-    // Or maybe V1/V2 *always* uses RLE?
-    // Most sources imply RLE is standard for Sampled brushes.
-    
-    // Let's compress row by row
-    QByteArray imgBytes;
-    for (int y = 0; y < alphaImg.height(); ++y) {
-        const uchar* scanLine = alphaImg.constScanLine(y);
-        QByteArray row((const char*)scanLine, alphaImg.width());
-        // For Photoshop brushes, is it 0=Transparent, 255=Opaque?
-        // Yes, usually.
-        imgBytes.append(encodePackBits(row));
+    m_out << (qint16)8; // 8-bit
+
+    m_inBrush = true;
+    return m_out.status() == QDataStream::Ok;
+}
+
+bool AbrStreamWriter::writeRows(const uchar* coverage, qsizetype stride, int rows) {
+    if (!m_inBrush) return false;
+    rows = std::min(rows, m_height - m_rowsWritten);
+    // Image Data: PackBits, row by row.
+    // 0 = No Ink (Transparent), 255 = Max Ink (Black).
+    for (int y = 0; y < rows; ++y) {
+        QByteArray row = QByteArray::fromRawData((const char*)(coverage + y * stride), m_width);
+        QByteArray packed = encodePackBits(row);
+        m_out.writeRawData(packed.constData(), packed.size());
+    }
+    m_rowsWritten += rows;
+    return m_out.status() == QDataStream::Ok;
+}
+
+bool AbrStreamWriter::endBrush() {
+    m_inBrush = false;
+    bool ok = m_rowsWritten == m_height && m_out.status() == QDataStream::Ok;
+    if (ok) {
+        qint64 end = m_device->pos();
+        ok = m_device->seek(m_sizePos);
+        m_out << (qint32)(end - m_sizePos - 4);
+        ok = ok && m_out.status() == QDataStream::Ok && m_device->seek(end);
+    }
+    if (ok) ++m_brushesWritten;
+    return ok;
+}
+
+bool AbrStreamWriter::finish() {
+    if (!m_device || !m_device->isOpen()) return false;
+    bool ok = !m_inBrush || endBrush();
+    ok = ok && m_brushesWritten == m_brushCount && m_out.status() == QDataStream::Ok;
+    m_out.setDevice(nullptr);
+    if (m_device == &m_file) {
+        m_file.close();
+        if (!ok) m_file.remove();
     }
-    
-    // Append image bytes to brushData
-    bOut.writeRawData(imgBytes.constData(), imgBytes.size());
-
-    // Write Type and Size to main stream
-    out << (qint16)2; // Type = Sampled
-    
-    // Size: Total bytes in brushData
-    qint32 size = static_cast<qint32>(brushData.size());
-    out << size;
-    
-    // Write the brush data
-    out.writeRawData(brushData.constData(), brushData.size());
-
-    file.close();
-    return true;
+    m_device = nullptr;
+    return ok;
 }
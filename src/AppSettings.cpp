@@ -2,6 +2,7 @@
 #include <QFile>
 #include <QJsonDocument>
 #include <QJsonObject>
+#include <algorithm>
 
 AppSettings& AppSettings::instance() {
     static AppSettings instance;
@@ -26,11 +27,15 @@ void AppSettings::load() {
             m_language = (Language)lang;
         }
     }
+    if (obj.contains("memoryCeilingMb")) {
+        m_memoryCeilingMb = std::max(0, obj["memoryCeilingMb"].toInt());
+    }
 }
 
 void AppSettings::save() {
     QJsonObject obj;
     obj["language"] = (int)m_language;
+    obj["memoryCeilingMb"] = m_memoryCeilingMb;
 
     QJsonDocument doc(obj);
     QFile file("settings.json");
@@ -49,3 +54,15 @@ void AppSettings::setLanguage(Language lang) {
         save();
     }
 }
+
+int AppSettings::getMemoryCeilingMb() const {
+    return m_memoryCeilingMb;
+}
+
+void AppSettings::setMemoryCeilingMb(int megabytes) {
+    megabytes = std::max(0, megabytes);
+    if (m_memoryCeilingMb != megabytes) {
+        m_memoryCeilingMb = megabytes;
+        save();
+    }
+}
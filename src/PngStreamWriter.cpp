@@ -0,0 +1,284 @@
+#include "PngStreamWriter.h"
+#include <QtEndian>
+#include <algorithm>
+#include <cstdlib>
+
+namespace {
+
+constexpr int kWindowSize = 32768;
+constexpr int kMinMatch = 3;
+constexpr int kMaxMatch = 258;
+constexpr int kHashBits = 15;
+constexpr int kIdatChunk = 65536;
+
+// Deflate length and distance alphabets (RFC 1951, 3.2.5)
+constexpr int kLengthBase[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+constexpr int kLengthExtra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                  3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr int kDistBase[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                               257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+constexpr int kDistExtra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                                7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+quint32 crc32(const QByteArray& data, quint32 crc = 0) {
+    static const auto table = [] {
+        std::vector<quint32> t(256);
+        for (quint32 n = 0; n < 256; ++n) {
+            quint32 c = n;
+            for (int k = 0; k < 8; ++k) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[n] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (char ch : data) crc = table[(crc ^ (uchar)ch) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+void appendBigEndian(QByteArray& out, quint32 value) {
+    char bytes[4];
+    qToBigEndian(value, bytes);
+    out.append(bytes, 4);
+}
+
+int paeth(int a, int b, int c) {
+    int p = a + b - c;
+    int pa = std::abs(p - a);
+    int pb = std::abs(p - b);
+    int pc = std::abs(p - c);
+    if (pa <= pb && pa <= pc) return a;
+    if (pb <= pc) return b;
+    return c;
+}
+
+} // namespace
+
+bool PngStreamWriter::begin(const QString& filename, int width, int height) {
+    m_width = width;
+    m_height = height;
+    m_rowsWritten = 0;
+    m_file.setFileName(filename);
+    m_ok = width > 0 && height > 0 && m_file.open(QIODevice::WriteOnly);
+    if (!m_ok) return false;
+
+    m_prevRow.assign((size_t)width * 2, 0);
+    m_currRow.assign((size_t)width * 2, 0);
+    m_filtered.assign((size_t)width * 2 + 1, 0);
+    m_window.clear();
+    m_head.assign(1 << kHashBits, -1);
+    m_pending = 0;
+    m_adlerA = 1;
+    m_adlerB = 0;
+    m_idat.clear();
+    m_bitBuffer = 0;
+    m_bitCount = 0;
+
+    static const char signature[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    m_ok = m_file.write(signature, 8) == 8;
+
+    // 8-bit gray + alpha, no interlace
+    QByteArray ihdr;
+    appendBigEndian(ihdr, (quint32)width);
+    appendBigEndian(ihdr, (quint32)height);
+    ihdr.append((char)8);
+    ihdr.append((char)4);
+    ihdr.append((char)0);
+    ihdr.append((char)0);
+    ihdr.append((char)0);
+    m_ok = m_ok && writeChunk("IHDR", ihdr);
+
+    // zlib header (deflate, 32K window), then one fixed Huffman block that
+    // stays open until finish()
+    m_idat.append((char)0x78);
+    m_idat.append((char)0x01);
+    putBits(0, 1);
+    putBits(1, 2);
+    trackBuffers();
+    return m_ok;
+}
+
+bool PngStreamWriter::writeRows(const uchar* coverage, qsizetype stride, int rows) {
+    if (!m_ok) return false;
+    rows = std::min(rows, m_height - m_rowsWritten);
+    for (int r = 0; r < rows; ++r) {
+        filterRow(coverage + r * stride);
+        deflate(m_filtered.data(), (int)m_filtered.size(), false);
+    }
+    m_rowsWritten += rows;
+    bool ok = flushIdat(false);
+    trackBuffers();
+    return ok;
+}
+
+bool PngStreamWriter::finish() {
+    if (m_ok && m_rowsWritten == m_height) {
+        deflate(nullptr, 0, true);
+        m_ok = flushIdat(true) && writeChunk("IEND", QByteArray());
+    } else {
+        m_ok = false;
+    }
+    m_file.close();
+    if (!m_ok) m_file.remove();
+    m_bufferBytes.set(0);
+    return m_ok;
+}
+
+// Picks the PNG filter with the smallest sum of absolute residuals, the usual
+// heuristic; the gray channel is constant so only alpha really varies
+void PngStreamWriter::filterRow(const uchar* coverage) {
+    const int n = m_width * 2;
+    for (int x = 0; x < m_width; ++x) {
+        m_currRow[2 * x] = 0;
+        m_currRow[2 * x + 1] = coverage[x];
+    }
+
+    long sums[5] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < n; ++i) {
+        int raw = m_currRow[i];
+        int left = i >= 2 ? m_currRow[i - 2] : 0;
+        int up = m_prevRow[i];
+        int upLeft = i >= 2 ? m_prevRow[i - 2] : 0;
+        sums[0] += std::abs((int)(qint8)raw);
+        sums[1] += std::abs((int)(qint8)(raw - left));
+        sums[2] += std::abs((int)(qint8)(raw - up));
+        sums[3] += std::abs((int)(qint8)(raw - ((left + up) >> 1)));
+        sums[4] += std::abs((int)(qint8)(raw - paeth(left, up, upLeft)));
+    }
+    int filter = (int)(std::min_element(sums, sums + 5) - sums);
+
+    m_filtered[0] = (uchar)filter;
+    for (int i = 0; i < n; ++i) {
+        int raw = m_currRow[i];
+        int left = i >= 2 ? m_currRow[i - 2] : 0;
+        int up = m_prevRow[i];
+        int upLeft = i >= 2 ? m_prevRow[i - 2] : 0;
+        int predicted = 0;
+        if (filter == 1) predicted = left;
+        else if (filter == 2) predicted = up;
+        else if (filter == 3) predicted = (left + up) >> 1;
+        else if (filter == 4) predicted = paeth(left, up, upLeft);
+        m_filtered[i + 1] = (uchar)(raw - predicted);
+    }
+    std::swap(m_prevRow, m_currRow);
+}
+
+// Greedy LZ77 with a single-entry hash table. Encoding stops kMaxMatch bytes
+// short of the end until the final call so matches are never cut by a row edge.
+void PngStreamWriter::deflate(const uchar* data, int size, bool final) {
+    for (int i = 0; i < size; ++i) {
+        m_adlerA = (m_adlerA + data[i]) % 65521;
+        m_adlerB = (m_adlerB + m_adlerA) % 65521;
+    }
+    m_window.insert(m_window.end(), data, data + size);
+
+    const int total = (int)m_window.size();
+    const int limit = final ? total : total - kMaxMatch;
+    const uchar* w = m_window.data();
+    auto hash = [w](int i) {
+        return ((w[i] << 10) ^ (w[i + 1] << 5) ^ w[i + 2]) & ((1 << kHashBits) - 1);
+    };
+
+    int i = m_pending;
+    while (i < limit) {
+        if (i + kMinMatch <= total) {
+            int h = hash(i);
+            int candidate = m_head[h];
+            m_head[h] = i;
+            if (candidate >= 0 && i - candidate <= kWindowSize) {
+                int maxLength = std::min(kMaxMatch, total - i);
+                int length = 0;
+                while (length < maxLength && w[candidate + length] == w[i + length]) ++length;
+                if (length >= kMinMatch) {
+                    emitMatch(length, i - candidate);
+                    for (int k = 1; k < length && i + k + kMinMatch <= total; ++k) m_head[hash(i + k)] = i + k;
+                    i += length;
+                    continue;
+                }
+            }
+        }
+        emitLiteral(w[i]);
+        ++i;
+    }
+    m_pending = std::max(i, m_pending);
+
+    if (final) {
+        putHuffman(0, 7); // End of the open block
+        putBits(1, 1);    // Empty final block
+        putBits(1, 2);
+        putHuffman(0, 7);
+        if (m_bitCount > 0) putBits(0, 8 - m_bitCount);
+        appendBigEndian(m_idat, (m_adlerB << 16) | m_adlerA);
+        return;
+    }
+
+    // Slide the window once it holds twice the match distance
+    if (m_pending > 2 * kWindowSize) {
+        int shift = m_pending - kWindowSize;
+        m_window.erase(m_window.begin(), m_window.begin() + shift);
+        m_pending -= shift;
+        for (int& pos : m_head) pos = pos >= shift ? pos - shift : -1;
+    }
+}
+
+void PngStreamWriter::emitLiteral(int value) {
+    if (value < 144) putHuffman(0x30 + value, 8);
+    else putHuffman(0x190 + value - 144, 9);
+}
+
+void PngStreamWriter::emitMatch(int length, int distance) {
+    int l = (int)(std::upper_bound(kLengthBase, kLengthBase + 29, length) - kLengthBase) - 1;
+    int symbol = 257 + l;
+    if (symbol < 280) putHuffman(symbol - 256, 7);
+    else putHuffman(0xC0 + symbol - 280, 8);
+    putBits(length - kLengthBase[l], kLengthExtra[l]);
+
+    int d = (int)(std::upper_bound(kDistBase, kDistBase + 30, distance) - kDistBase) - 1;
+    putHuffman(d, 5);
+    putBits(distance - kDistBase[d], kDistExtra[d]);
+}
+
+void PngStreamWriter::putBits(quint32 bits, int count) {
+    m_bitBuffer |= bits << m_bitCount;
+    m_bitCount += count;
+    while (m_bitCount >= 8) {
+        m_idat.append((char)(m_bitBuffer & 0xFF));
+        m_bitBuffer >>= 8;
+        m_bitCount -= 8;
+    }
+}
+
+// Huffman codes are packed most significant bit first
+void PngStreamWriter::putHuffman(quint32 code, int length) {
+    quint32 reversed = 0;
+    for (int k = 0; k < length; ++k) reversed |= ((code >> k) & 1) << (length - 1 - k);
+    putBits(reversed, length);
+}
+
+bool PngStreamWriter::writeChunk(const char* type, const QByteArray& data) {
+    QByteArray chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, (quint32)data.size());
+    chunk.append(type, 4);
+    chunk.append(data);
+    appendBigEndian(chunk, crc32(chunk.mid(4)));
+    return m_file.write(chunk) == chunk.size();
+}
+
+bool PngStreamWriter::flushIdat(bool all) {
+    while (m_ok && m_idat.size() >= kIdatChunk) {
+        m_ok = writeChunk("IDAT", m_idat.left(kIdatChunk));
+        m_idat.remove(0, kIdatChunk);
+    }
+    if (m_ok && all && !m_idat.isEmpty()) {
+        m_ok = writeChunk("IDAT", m_idat);
+        m_idat.clear();
+    }
+    return m_ok;
+}
+
+// Row, window and IDAT buffers, for the Encode stage of the memory tracker
+void PngStreamWriter::trackBuffers() {
+    m_bufferBytes.set((qint64)(m_prevRow.capacity() + m_currRow.capacity() + m_filtered.capacity() + m_window.capacity()
+                               + m_head.capacity() * sizeof(int)) + m_idat.capacity());
+}
@@ -0,0 +1,305 @@
+#include "RenderServer.h"
+#include "AbrReader.h"
+#include "AbrWriter.h"
+#include "BrushLayers.h"
+#include "MemoryTracker.h"
+#include <QBuffer>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <numeric>
+
+namespace {
+
+// Interval between throughput reports on stderr
+constexpr int kStatsIntervalMs = 5000;
+
+// Longest request line accepted; a client that sends more is dropped
+constexpr qint64 kMaxRequestBytes = 16 * 1024 * 1024;
+
+double percentile(std::vector<double> samples, double p) {
+    if (samples.empty()) return 0.0;
+    size_t index = std::min(samples.size() - 1, (size_t)(p * (samples.size() - 1) + 0.5));
+    std::nth_element(samples.begin(), samples.begin() + index, samples.end());
+    return samples[index];
+}
+
+double mean(const std::vector<double>& samples) {
+    return samples.empty() ? 0.0 : std::accumulate(samples.begin(), samples.end(), 0.0) / samples.size();
+}
+
+} // namespace
+
+RenderServer::RenderServer(QObject* parent) : QObject(parent) {
+    connect(&m_server, &QLocalServer::newConnection, this, &RenderServer::acceptConnections);
+    connect(&m_statsTimer, &QTimer::timeout, this, &RenderServer::reportStats);
+    m_clock.start();
+}
+
+RenderServer::~RenderServer() {
+    // Workers post their replies back to this object
+    m_pool.waitForDone();
+}
+
+bool RenderServer::listen(const QString& name, int threads) {
+    if (threads > 0) m_pool.setMaxThreadCount(threads);
+
+    // A socket left behind by a crashed server would block the name
+    QLocalServer::removeServer(name);
+    if (!m_server.listen(name)) return false;
+
+    std::fprintf(stderr, "brush-synth: serving on %s with %d workers\n",
+                 qPrintable(m_server.fullServerName()), m_pool.maxThreadCount());
+    m_intervalStartNs = m_clock.nsecsElapsed();
+    m_statsTimer.start(kStatsIntervalMs);
+    return true;
+}
+
+QString RenderServer::errorString() const {
+    return m_server.errorString();
+}
+
+void RenderServer::acceptConnections() {
+    while (QLocalSocket* socket = m_server.nextPendingConnection()) {
+        connect(socket, &QLocalSocket::readyRead, this, [this, socket]() { readRequests(socket); });
+        connect(socket, &QLocalSocket::disconnected, this, [this, socket]() {
+            m_segments.remove(socket);
+            socket->deleteLater();
+        });
+    }
+}
+
+// Takes every complete line the socket has buffered, so requests that arrive
+// together are queued on the pool together
+void RenderServer::readRequests(QLocalSocket* socket) {
+    while (socket->canReadLine()) {
+        QByteArray line = socket->readLine().trimmed();
+        if (line.isEmpty()) continue;
+
+        QJsonParseError error;
+        QJsonDocument doc = QJsonDocument::fromJson(line, &error);
+        if (!doc.isObject()) {
+            QJsonObject header;
+            header["ok"] = false;
+            header["error"] = "Invalid JSON: " + error.errorString();
+            header["bytes"] = 0;
+            write(socket, header);
+            continue;
+        }
+
+        QJsonObject request = doc.object();
+        if (request.contains("command")) {
+            runCommand(socket, request);
+            continue;
+        }
+
+        Job job;
+        job.socket = socket;
+        job.id = request.value("id");
+        job.settings = request.contains("settings") ? request["settings"].toObject() : request;
+        job.format = request.value("format").toString("png").toLower();
+        job.name = request.value("name").toString("Brush");
+        job.serial = ++m_requestCounter;
+        job.queuedNs = m_clock.nsecsElapsed();
+
+        ++m_pending;
+        m_pool.start([this, job]() {
+            Reply reply = render(job, m_clock.nsecsElapsed());
+            QMetaObject::invokeMethod(this, [this, job, reply]() { deliver(job, reply); }, Qt::QueuedConnection);
+        });
+    }
+
+    if (socket->bytesAvailable() > kMaxRequestBytes) {
+        std::fprintf(stderr, "brush-synth: dropping client, request too large\n");
+        socket->abort();
+    }
+}
+
+void RenderServer::runCommand(QLocalSocket* socket, const QJsonObject& request) {
+    QString command = request["command"].toString();
+    QJsonObject header;
+    header["id"] = request.value("id");
+    header["bytes"] = 0;
+    if (command == "stats") {
+        header["ok"] = true;
+        header["stats"] = stats();
+    } else if (command == "release") {
+        header["ok"] = m_segments[socket].remove(request["key"].toString()) > 0;
+    } else {
+        header["ok"] = false;
+        header["error"] = "Unknown command: " + command;
+    }
+    write(socket, header);
+}
+
+// Worker thread: everything here is local to the job
+RenderServer::Reply RenderServer::render(const Job& job, qint64 startedNs) {
+    Reply reply;
+    reply.queueNs = startedNs - job.queuedNs;
+    reply.header["id"] = job.id;
+    reply.header["format"] = job.format;
+
+    BrushLayers layers;
+    auto loadMap = [this](const QString& path) { return densityMap(path); };
+    auto loadStamp = [this](const QString& source) { return stampImage(source); };
+    for (const BrushLayers::Layer& layer : BrushSettings::layers(job.settings, loadMap, loadStamp)) {
+        layers.insertLayer(layers.count(), layer);
+    }
+    QImage image = layers.composite();
+
+    bool ok = !image.isNull();
+    if (ok && job.format == "png") {
+        QBuffer buffer(&reply.payload);
+        buffer.open(QIODevice::WriteOnly);
+        ok = image.save(&buffer, "PNG");
+    } else if (ok && job.format == "abr") {
+        reply.payload = AbrWriter::abrData(image, job.name, BrushSettings::spacing(job.settings));
+        ok = !reply.payload.isEmpty();
+    } else if (ok && job.format == "shm") {
+        // Raw coverage, tightly packed, for clients that map it directly
+        QImage coverage = image.convertToFormat(QImage::Format_Alpha8);
+        QString key = QString("brush-synth-%1-%2").arg(QCoreApplication::applicationPid()).arg(job.serial);
+        auto segment = std::make_shared<QSharedMemory>(key);
+        ok = segment->create(coverage.width() * coverage.height());
+        if (ok) {
+            segment->lock();
+            uchar* data = static_cast<uchar*>(segment->data());
+            for (int y = 0; y < coverage.height(); ++y) {
+                std::memcpy(data + (qsizetype)y * coverage.width(), coverage.constScanLine(y), coverage.width());
+            }
+            segment->unlock();
+            reply.segment = segment;
+            reply.header["key"] = key;
+            reply.header["stride"] = coverage.width();
+        } else {
+            reply.header["error"] = segment->errorString();
+        }
+    } else if (ok) {
+        ok = false;
+        reply.header["error"] = "Unknown format: " + job.format;
+    }
+
+    reply.header["ok"] = ok;
+    if (ok) {
+        reply.header["width"] = image.width();
+        reply.header["height"] = image.height();
+    } else {
+        reply.payload.clear();
+        if (!reply.header.contains("error")) reply.header["error"] = "Render failed";
+    }
+    reply.renderNs = m_clock.nsecsElapsed() - startedNs;
+    return reply;
+}
+
+// Main thread
+void RenderServer::deliver(const Job& job, Reply reply) {
+    --m_pending;
+    if (reply.header["ok"].toBool()) ++m_served;
+    else ++m_failed;
+    m_queueMs.push_back(reply.queueNs / 1e6);
+    m_renderMs.push_back(reply.renderNs / 1e6);
+
+    // The client may have gone while the job was queued
+    if (!job.socket || job.socket->state() != QLocalSocket::ConnectedState) return;
+
+    reply.header["queueMs"] = reply.queueNs / 1e6;
+    reply.header["renderMs"] = reply.renderNs / 1e6;
+    if (reply.segment) {
+        m_segments[job.socket.data()].insert(reply.header["key"].toString(), reply.segment);
+    }
+    write(job.socket.data(), reply.header, reply.payload);
+}
+
+void RenderServer::write(QLocalSocket* socket, const QJsonObject& header, const QByteArray& payload) {
+    QJsonObject sized = header;
+    sized["bytes"] = (qint64)payload.size();
+    socket->write(QJsonDocument(sized).toJson(QJsonDocument::Compact));
+    socket->write("\n");
+    if (!payload.isEmpty()) socket->write(payload);
+}
+
+QJsonObject RenderServer::stats() const {
+    QJsonObject json = m_lastInterval;
+    json["served"] = m_served;
+    json["failed"] = m_failed;
+    json["pending"] = m_pending;
+    json["workers"] = m_pool.maxThreadCount();
+
+    const MemoryTracker& tracker = MemoryTracker::instance();
+    QJsonObject memory;
+    for (int s = 0; s < MemoryTracker::StageCount; ++s) {
+        QJsonObject stage;
+        stage["bytes"] = tracker.current((MemoryTracker::Stage)s);
+        stage["peakBytes"] = tracker.peak((MemoryTracker::Stage)s);
+        memory[MemoryTracker::stageName(s)] = stage;
+    }
+    memory["bytes"] = tracker.current();
+    memory["peakBytes"] = tracker.peak();
+    memory["ceilingBytes"] = tracker.ceiling();
+    json["memory"] = memory;
+    return json;
+}
+
+// Sustained throughput and latency over the last interval
+void RenderServer::reportStats() {
+    qint64 now = m_clock.nsecsElapsed();
+    double seconds = (now - m_intervalStartNs) / 1e9;
+    size_t completed = m_queueMs.size();
+
+    QJsonObject interval;
+    interval["intervalSeconds"] = seconds;
+    interval["requestsPerSecond"] = seconds > 0 ? completed / seconds : 0.0;
+    interval["queueMsMean"] = mean(m_queueMs);
+    interval["queueMsP95"] = percentile(m_queueMs, 0.95);
+    interval["renderMsMean"] = mean(m_renderMs);
+    interval["renderMsP95"] = percentile(m_renderMs, 0.95);
+    m_lastInterval = interval;
+
+    MemoryTracker& tracker = MemoryTracker::instance();
+    interval["memoryBytes"] = tracker.current();
+    interval["memoryPeakBytes"] = tracker.peak();
+
+    if (completed > 0) {
+        std::fprintf(stderr, "brush-synth: %.1f req/s, queue %.2f ms (p95 %.2f), render %.2f ms (p95 %.2f), "
+                     "%d pending, memory %.1f MB (peak %.1f)\n",
+                     interval["requestsPerSecond"].toDouble(), interval["queueMsMean"].toDouble(),
+                     interval["queueMsP95"].toDouble(), interval["renderMsMean"].toDouble(),
+                     interval["renderMsP95"].toDouble(), m_pending, tracker.current() / 1048576.0,
+                     tracker.peak() / 1048576.0);
+    }
+    tracker.resetPeak();
+    m_queueMs.clear();
+    m_renderMs.clear();
+    m_intervalStartNs = now;
+}
+
+std::shared_ptr<const DensityMap> RenderServer::densityMap(const QString& path) {
+    std::lock_guard<std::mutex> lock(m_mapMutex);
+    auto it = m_densityMaps.find(path);
+    if (it != m_densityMaps.end()) return it.value();
+    evictCaches();
+    std::shared_ptr<const DensityMap> map = DensityMap::fromImage(QImage(path));
+    m_densityMaps.insert(path, map);
+    return map;
+}
+
+std::shared_ptr<const StampMipChain> RenderServer::stampImage(const QString& source) {
+    std::lock_guard<std::mutex> lock(m_mapMutex);
+    auto it = m_stampImages.find(source);
+    if (it != m_stampImages.end()) return it.value();
+    evictCaches();
+    std::shared_ptr<const StampMipChain> stamp = StampMipChain::fromTip(AbrReader::loadTip(source));
+    m_stampImages.insert(source, stamp);
+    return stamp;
+}
+
+// Called with m_mapMutex held. Jobs still rendering keep their own references,
+// so only maps and stamps no job is using are freed.
+void RenderServer::evictCaches() {
+    if (!MemoryTracker::instance().overCeiling()) return;
+    m_densityMaps.clear();
+    m_stampImages.clear();
+}
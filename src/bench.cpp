@@ -0,0 +1,626 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QStringList>
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+#include "TextureGenerator.h"
+#include "MemoryTracker.h"
+#include "AbrReader.h"
+#include "AbrWriter.h"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Render benchmark for TextureGenerator.
+//   brush-synth-bench [--iterations N] [--compare] [--no-aa] [--tessellation] [--abr [FILE]]
+//   brush-synth-bench --record DIR [--budgets] | --regress DIR [--tolerance N] [--iterations N]
+// --compare also times the generic (runtime-branching) kernels and prints the
+// per-particle speedup of the specialized ones. A second table gives the render
+// time of every anti-aliasing level unless --no-aa is passed, and a third one
+// compares 8-bit against 16-bit (high precision) accumulation. "skip %" is the
+// share of particles dropped over already-saturated tiles; with --compare the
+// render time without that early-out is shown too. "peak MB" is the
+// MemoryTracker high-water mark of one render. The last table compares
+// emission order against spatially sorted (Z-order) rasterization, with
+// hardware cache misses where Linux perf events are available.
+// --tessellation diffs every outline case against a near-exact tessellation,
+// both as rendered and with the fixed 30 + min(size, 100) outline steps the
+// error-bounded step model replaced, and reports outline vertices per
+// particle for both. It exits non-zero if the step model is less accurate
+// than the old rule in any case.
+// --abr round-trips every case through AbrWriter and AbrReader and checks the
+// decoded brush against the render; given an ABR library it also times
+// opening (indexing) it and decoding each of its brushes.
+// --record stores the coverage of every case but the million-grain one in DIR
+// as a grayscale PNG; with --budgets it also writes a render time budget per
+// case to DIR/budgets.json. --regress renders those cases again and exits
+// non-zero if any pixel differs from its golden by more than --tolerance
+// levels (default 2), if the ABR round trip does not decode to the render,
+// or, where DIR has a budgets.json, if place plus render time exceeds the
+// budget. Cases are only timed against a budget. The cases use fixed seeds,
+// but edge coverage comes from QPainter's anti-aliasing: the goldens in
+// tests/golden were drawn by the Qt 6.12 raster engine, and CMake only
+// registers them as a test against that Qt release. Budgets are recorded
+// with headroom on the machine that checks them and can be edited by hand.
+
+// Count operator new calls so per-render allocator traffic is visible next to
+// the timings. Where the platform lets an executable replace operator new for
+// its libraries (ELF), this includes allocations made inside Qt.
+static std::atomic<long long> g_allocations{0};
+
+void* operator new(std::size_t size) {
+    ++g_allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+// Last-level cache misses of the calling thread, from a Linux perf event.
+// stop() returns -1 where the counter cannot be opened, e.g. without a PMU
+// in a VM or when perf_event_paranoid forbids it.
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+#ifdef __linux__
+        perf_event_attr attr{};
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        m_fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+#endif
+    }
+
+    ~CacheMissCounter() {
+#ifdef __linux__
+        if (m_fd >= 0) close(m_fd);
+#endif
+    }
+
+    void start() {
+#ifdef __linux__
+        if (m_fd < 0) return;
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+#endif
+    }
+
+    long long stop() {
+#ifdef __linux__
+        if (m_fd < 0) return -1;
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        long long count = 0;
+        if (read(m_fd, &count, sizeof(count)) == (ssize_t)sizeof(count)) return count;
+#endif
+        return -1;
+    }
+
+private:
+    int m_fd = -1;
+};
+
+struct BenchCase {
+    const char* name;
+    TextureGenerator::Parameters params;
+};
+
+TextureGenerator::Parameters baseParams() {
+    TextureGenerator::Parameters params;
+    params.canvasSize = 1024;
+    params.count = 20000;
+    params.sizeMean = 8;
+    params.sizeJitter = 50;
+    params.opacityMean = 128;
+    params.opacityJitter = 50;
+    params.roundness = 100;
+    params.angle = 0;
+    params.falloff = 0;
+    params.distributionSquareness = 0;
+    params.distType = 0;
+    params.distJitter = 0;
+    params.seed = 1234;
+    params.shapeId = 0;
+    params.polygonSides = 5;
+    params.shapeEdgeFreq = 0;
+    params.shapeEdgeAmp = 0;
+    params.shapeWarpFreq = 1;
+    params.shapeWarpAmp = 0;
+    params.waveThreshold = 50;
+    params.particleAngle = 0;
+    params.particleAngleJitter = 0;
+    params.particleRoundness = 100;
+    return params;
+}
+
+std::vector<BenchCase> benchCases() {
+    std::vector<BenchCase> cases;
+
+    cases.push_back({"circle", baseParams()});
+
+    BenchCase poly{"polygon-edge-warp", baseParams()};
+    poly.params.shapeId = 3;
+    poly.params.polygonSides = 6;
+    poly.params.shapeEdgeFreq = 8;
+    poly.params.shapeEdgeAmp = 30;
+    poly.params.shapeWarpFreq = 3;
+    poly.params.shapeWarpAmp = 40;
+    poly.params.particleAngleJitter = 100;
+    cases.push_back(poly);
+
+    BenchCase tri{"triangle-falloff-square", baseParams()};
+    tri.params.shapeId = 1;
+    tri.params.falloff = 40;
+    tri.params.distributionSquareness = 60;
+    tri.params.particleAngleJitter = 50;
+    cases.push_back(tri);
+
+    BenchCase grid{"grid-square", baseParams()};
+    grid.params.distType = 1;
+    grid.params.distJitter = 30;
+    grid.params.distributionSquareness = 50;
+    grid.params.shapeId = 2;
+    cases.push_back(grid);
+
+    BenchCase spiral{"spiral-edge", baseParams()};
+    spiral.params.distType = 2;
+    spiral.params.shapeEdgeFreq = 6;
+    spiral.params.shapeEdgeAmp = 25;
+    cases.push_back(spiral);
+
+    // The spiral-edge outline written as an expression, to price the interpreter
+    BenchCase expression{"expression-edge", baseParams()};
+    expression.params.distType = 2;
+    expression.params.shapeId = 6;
+    expression.params.radiusExpression = TextureGenerator::compileRadiusExpression("1 + 0.25 * sin(6 * t + 13.5 * i)");
+    cases.push_back(expression);
+
+    BenchCase blue{"bluenoise", baseParams()};
+    blue.params.distType = 3;
+    cases.push_back(blue);
+
+    BenchCase wave{"wavetable", baseParams()};
+    wave.params.shapeId = 4;
+    wave.params.sizeMean = 24;
+    wave.params.shapeEdgeFreq = 4;
+    wave.params.shapeEdgeAmp = 20;
+    wave.params.particleAngleJitter = 100;
+    cases.push_back(wave);
+
+    // Imported tip: a small rendered brush, loaded once like a user's image
+    static const std::shared_ptr<const StampMipChain> tip = [] {
+        TextureGenerator::Parameters tipParams = baseParams();
+        tipParams.canvasSize = 256;
+        tipParams.count = 300;
+        tipParams.sizeMean = 20;
+        return StampMipChain::fromTip(TextureGenerator::generate(tipParams));
+    }();
+    BenchCase image{"image-stamp", baseParams()};
+    image.params.shapeId = 5;
+    image.params.stampImage = tip;
+    image.params.sizeMean = 24;
+    image.params.particleAngleJitter = 100;
+    cases.push_back(image);
+
+    BenchCase grain{"grain-1M", baseParams()};
+    grain.params.canvasSize = 2048;
+    grain.params.count = 1000000;
+    grain.params.sizeMean = 1;
+    grain.params.sizeJitter = 100;
+    grain.params.opacityMean = 60;
+    cases.push_back(grain);
+
+    BenchCase dense{"dense-falloff", baseParams()};
+    dense.params.count = 200000;
+    dense.params.sizeMean = 6;
+    dense.params.opacityMean = 255;
+    dense.params.opacityJitter = 0;
+    dense.params.falloff = 80;
+    cases.push_back(dense);
+
+    return cases;
+}
+
+struct Timing {
+    double placeMs = 0;
+    double renderMs = 0;
+    long long renderAllocations = 0;
+    size_t particles = 0;
+    double skipPercent = 0;
+    long long cacheMisses = -1; // Median over the iterations, -1 if unavailable
+    long long vertices = 0;
+    qint64 peakBytes = 0; // Tracked memory high-water mark of a render
+};
+
+// Median of the iterations, after one warm-up run
+Timing measure(const TextureGenerator::Parameters& params, int iterations,
+               const TextureGenerator::BenchOptions* options = nullptr) {
+    std::vector<double> placeTimes;
+    std::vector<double> renderTimes;
+    std::vector<long long> misses;
+    Timing timing;
+    static CacheMissCounter cacheMisses;
+
+    for (int i = 0; i <= iterations; ++i) {
+        QElapsedTimer timer;
+        timer.start();
+        std::vector<TextureGenerator::Particle> particles = TextureGenerator::place(params, options);
+        double placeMs = timer.nsecsElapsed() / 1e6;
+
+        TextureGenerator::RenderStats stats;
+        long long allocationsBefore = g_allocations.load();
+        MemoryTracker::instance().resetPeak();
+        cacheMisses.start();
+        timer.restart();
+        QImage image = TextureGenerator::render(params, particles, &stats, options);
+        double renderMs = timer.nsecsElapsed() / 1e6;
+        long long renderMisses = cacheMisses.stop();
+        timing.renderAllocations = g_allocations.load() - allocationsBefore;
+        timing.peakBytes = MemoryTracker::instance().peak();
+        timing.skipPercent = 100.0 * stats.skipped / std::max<qint64>(1, stats.particles);
+        timing.vertices = stats.vertices;
+
+        if (i == 0) continue;
+        placeTimes.push_back(placeMs);
+        renderTimes.push_back(renderMs);
+        misses.push_back(renderMisses);
+        timing.particles = particles.size();
+    }
+
+    auto median = [](std::vector<double>& v) {
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    };
+    timing.placeMs = median(placeTimes);
+    timing.renderMs = median(renderTimes);
+    std::sort(misses.begin(), misses.end());
+    timing.cacheMisses = misses[misses.size() / 2];
+    return timing;
+}
+
+// Recorded budgets allow this much over the time measured at --record
+constexpr double kBudgetHeadroom = 1.5;
+
+// The coverage bytes viewed as gray, so a PNG stores them exactly
+QImage grayscaleOf(const QImage& coverage) {
+    return QImage(coverage.constBits(), coverage.width(), coverage.height(), coverage.bytesPerLine(),
+                  QImage::Format_Grayscale8).copy();
+}
+
+// Records or checks the golden images in dir, and the time budgets when
+// recordBudgets is set or a budgets.json is there; returns the exit code.
+// Budgets are timings of one machine, so they stay out of the checked-in set.
+int runGoldens(const QString& dir, bool record, bool recordBudgets, int iterations, int tolerance) {
+    QDir goldenDir(dir);
+    const QString budgetsPath = goldenDir.filePath("budgets.json");
+    QJsonObject budgets;
+    if (record) {
+        if (!goldenDir.mkpath(".")) {
+            std::fprintf(stderr, "%s: cannot create directory\n", qPrintable(dir));
+            return 1;
+        }
+    } else {
+        QFile file(budgetsPath);
+        if (file.open(QIODevice::ReadOnly)) budgets = QJsonDocument::fromJson(file.readAll()).object();
+    }
+
+    std::printf("%-26s %8s %8s %10s %10s %6s %8s\n", record ? "golden record" : "golden regress", "max diff",
+                "over px", "ms", "budget ms", "abr", "result");
+    int cases = 0;
+    int failures = 0;
+    for (const BenchCase& bench : benchCases()) {
+        // No golden for the million-grain case: its 2048 px PNG would be a
+        // third of tests/golden
+        if (bench.params.count >= 1000000) continue;
+        ++cases;
+
+        const QString name = bench.name;
+        QImage coverage = TextureGenerator::renderCoverage(bench.params, TextureGenerator::place(bench.params));
+
+        // measure() renders the case again, so only for a budget
+        const bool timed = record ? recordBudgets : budgets.contains(name);
+        double ms = 0;
+        if (timed) {
+            Timing t = measure(bench.params, iterations);
+            ms = t.placeMs + t.renderMs;
+        }
+
+        // The same cases as --abr, which leaves out the dense ones
+        const bool abrChecked = bench.params.count <= 100000;
+        AbrReader reader;
+        const bool abrOk = !abrChecked || (reader.open(AbrWriter::abrData(coverage, name)) && reader.count() == 1
+                                           && reader.image(0) == coverage);
+        const char* abrResult = !abrChecked ? "-" : (abrOk ? "ok" : "FAIL");
+
+        const QString goldenPath = goldenDir.filePath(name + ".png");
+        if (record) {
+            const bool ok = grayscaleOf(coverage).save(goldenPath, "PNG") && abrOk;
+            if (!ok) ++failures;
+            std::printf("%-26s %8s %8s", bench.name, "-", "-");
+            if (recordBudgets) {
+                QJsonObject entry;
+                entry["budgetMs"] = ms * kBudgetHeadroom;
+                budgets[name] = entry;
+                std::printf(" %10.2f %10.2f", ms, ms * kBudgetHeadroom);
+            } else {
+                std::printf(" %10s %10s", "-", "none");
+            }
+            std::printf(" %6s %8s\n", abrResult, ok ? "recorded" : "FAIL");
+            continue;
+        }
+
+        // -1: no golden of this size
+        int maxDiff = -1;
+        long long overPixels = 0;
+        QImage golden = QImage(goldenPath).convertToFormat(QImage::Format_Grayscale8);
+        if (golden.size() == coverage.size()) {
+            maxDiff = 0;
+            for (int y = 0; y < coverage.height(); ++y) {
+                const uchar* rowA = coverage.constScanLine(y);
+                const uchar* rowB = golden.constScanLine(y);
+                for (int x = 0; x < coverage.width(); ++x) {
+                    int d = std::abs(rowA[x] - rowB[x]);
+                    maxDiff = std::max(maxDiff, d);
+                    if (d > tolerance) ++overPixels;
+                }
+            }
+        }
+        const double budget = budgets[name].toObject()["budgetMs"].toDouble(0); // 0: no budget yet
+        const bool imageOk = maxDiff >= 0 && maxDiff <= tolerance;
+        const bool timeOk = budget <= 0 || ms <= budget;
+        const bool ok = imageOk && timeOk && abrOk;
+        if (!ok) ++failures;
+
+        std::printf("%-26s", bench.name);
+        if (maxDiff < 0) std::printf(" %8s %8s", "missing", "-");
+        else std::printf(" %8d %8lld", maxDiff, overPixels);
+        if (timed) std::printf(" %10.2f %10.2f", ms, budget);
+        else std::printf(" %10s %10s", "-", "none");
+        std::printf(" %6s %8s\n", abrResult,
+                    ok ? "pass" : (!imageOk ? "IMAGE" : (!timeOk ? "SLOW" : "ABR")));
+    }
+
+    if (recordBudgets) {
+        QFile file(budgetsPath);
+        if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(budgets).toJson()) < 0) {
+            std::fprintf(stderr, "%s: %s\n", qPrintable(budgetsPath), qPrintable(file.errorString()));
+            return 1;
+        }
+    }
+    std::printf("%d of %d cases failed\n", failures, cases);
+    return failures > 0 ? 1 : 0;
+}
+
+// Largest and mean absolute alpha difference between two renders
+void imageDiff(const QImage& a, const QImage& b, int& maxDiff, double& meanDiff) {
+    maxDiff = 0;
+    long long sum = 0;
+    for (int y = 0; y < a.height(); ++y) {
+        const QRgb* rowA = reinterpret_cast<const QRgb*>(a.constScanLine(y));
+        const QRgb* rowB = reinterpret_cast<const QRgb*>(b.constScanLine(y));
+        for (int x = 0; x < a.width(); ++x) {
+            int d = std::abs(qAlpha(rowA[x]) - qAlpha(rowB[x]));
+            maxDiff = std::max(maxDiff, d);
+            sum += d;
+        }
+    }
+    meanDiff = (double)sum / std::max<qint64>(1, (qint64)a.width() * a.height());
+}
+
+// Outline tolerance of the near-exact tessellation the outline cases are checked against
+constexpr double kExactOutlineTolerance = 0.01;
+
+bool hasOutline(const TextureGenerator::Parameters& params) {
+    return (params.shapeId >= 1 && params.shapeId <= 3) || (params.shapeId == 6 && params.radiusExpression)
+        || (params.shapeId == 0 && params.shapeEdgeFreq > 0);
+}
+
+// Error of an outline case against a near-exact tessellation, with the
+// step model and with the fixed 30 + min(size, 100) steps it replaced.
+// The step model fails where it is less accurate than the old rule.
+struct OutlineError {
+    int maxDiff = 0;
+    double meanDiff = 0;
+    int legacyMaxDiff = 0;
+    double legacyMeanDiff = 0;
+
+    bool ok() const { return maxDiff <= legacyMaxDiff && meanDiff <= legacyMeanDiff; }
+};
+
+OutlineError outlineError(const TextureGenerator::Parameters& params) {
+    TextureGenerator::BenchOptions legacy;
+    legacy.legacyOutlineSteps = true;
+    TextureGenerator::Parameters exact = params;
+    exact.outlineTolerance = kExactOutlineTolerance;
+
+    std::vector<TextureGenerator::Particle> particles = TextureGenerator::place(params);
+    QImage exactImage = TextureGenerator::render(exact, particles);
+    OutlineError error;
+    imageDiff(TextureGenerator::render(params, particles), exactImage, error.maxDiff, error.meanDiff);
+    imageDiff(TextureGenerator::render(params, particles, nullptr, &legacy), exactImage, error.legacyMaxDiff,
+              error.legacyMeanDiff);
+    return error;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    QCoreApplication app(argc, argv);
+    QStringList args = app.arguments();
+
+    int iterations = 5;
+    int iterIndex = args.indexOf("--iterations");
+    if (iterIndex > 0 && iterIndex + 1 < args.size()) iterations = std::max(1, args[iterIndex + 1].toInt());
+    bool compare = args.contains("--compare");
+
+    for (const char* mode : {"--record", "--regress"}) {
+        int modeIndex = args.indexOf(mode);
+        if (modeIndex < 0) continue;
+        if (modeIndex + 1 >= args.size()) {
+            std::fprintf(stderr, "%s needs a directory\n", mode);
+            return 2;
+        }
+        int toleranceIndex = args.indexOf("--tolerance");
+        int tolerance = toleranceIndex > 0 && toleranceIndex + 1 < args.size() ? std::max(0, args[toleranceIndex + 1].toInt()) : 2;
+        const bool record = std::strcmp(mode, "--record") == 0;
+        return runGoldens(args[modeIndex + 1], record, record && args.contains("--budgets"), iterations, tolerance);
+    }
+
+    std::printf("%-26s %9s %10s %10s %10s %8s %7s %8s", "case", "particles", "place ms", "render ms", "ns/part", "allocs",
+                "skip %", "peak MB");
+    if (compare) std::printf(" %10s %8s %10s", "generic ns", "speedup", "noskip ms");
+    std::printf("\n");
+
+    for (const BenchCase& bench : benchCases()) {
+        Timing t = measure(bench.params, iterations);
+        double nsPerParticle = (t.placeMs + t.renderMs) * 1e6 / std::max<size_t>(1, t.particles);
+        std::printf("%-26s %9zu %10.2f %10.2f %10.1f %8lld %7.1f %8.1f", bench.name, t.particles, t.placeMs, t.renderMs,
+                    nsPerParticle, t.renderAllocations, t.skipPercent, t.peakBytes / 1048576.0);
+
+        if (compare) {
+            TextureGenerator::BenchOptions generic;
+            generic.specializeKernels = false;
+            Timing g = measure(bench.params, iterations, &generic);
+            double genericNs = (g.placeMs + g.renderMs) * 1e6 / std::max<size_t>(1, g.particles);
+            std::printf(" %10.1f %7.2fx", genericNs, genericNs / nsPerParticle);
+
+            TextureGenerator::BenchOptions noSkip;
+            noSkip.skipSaturated = false;
+            std::printf(" %10.2f", measure(bench.params, iterations, &noSkip).renderMs);
+        }
+        std::printf("\n");
+    }
+
+    if (!args.contains("--no-aa")) {
+        // Render cost of each anti-aliasing level relative to analytic coverage
+        struct AaLevel { const char* name; int supersampling; };
+        const AaLevel levels[] = {{"analytic", 0}, {"off", 1}, {"2x", 2}, {"4x", 4}, {"8x", 8}};
+
+        std::printf("\n%-26s", "render ms by AA");
+        for (const AaLevel& level : levels) std::printf(" %10s", level.name);
+        std::printf("\n");
+
+        for (const BenchCase& bench : benchCases()) {
+            if (bench.params.count > 100000) continue; // 8x on the grain case takes minutes
+            std::printf("%-26s", bench.name);
+            for (const AaLevel& level : levels) {
+                TextureGenerator::Parameters params = bench.params;
+                params.supersampling = level.supersampling;
+                std::printf(" %10.2f", measure(params, iterations).renderMs);
+            }
+            std::printf("\n");
+        }
+    }
+
+    // Cost of 16-bit accumulation plus the final dither
+    std::printf("\n%-26s %10s %10s %8s\n", "render ms by precision", "8-bit", "16-bit", "ratio");
+    for (const BenchCase& bench : benchCases()) {
+        TextureGenerator::Parameters precise = bench.params;
+        precise.highPrecision = true;
+        double ms8 = measure(bench.params, iterations).renderMs;
+        double ms16 = measure(precise, iterations).renderMs;
+        std::printf("%-26s %10.2f %10.2f %7.2fx\n", bench.name, ms8, ms16, ms16 / ms8);
+    }
+
+    // Particle submission order: emission order against Z-order tiles
+    auto printMisses = [](long long count) {
+        if (count < 0) std::printf(" %12s", "n/a");
+        else std::printf(" %11.1fk", count / 1000.0);
+    };
+    std::printf("\n%-26s %10s %10s %12s %12s\n", "render by particle order", "emit ms", "sorted ms", "emit miss", "sorted miss");
+    for (const BenchCase& bench : benchCases()) {
+        TextureGenerator::BenchOptions emission;
+        emission.spatialSort = false;
+        Timing e = measure(bench.params, iterations, &emission);
+        Timing z = measure(bench.params, iterations);
+        std::printf("%-26s %10.2f %10.2f", bench.name, e.renderMs, z.renderMs);
+        printMisses(e.cacheMisses);
+        printMisses(z.cacheMisses);
+        std::printf("\n");
+    }
+
+    int exitCode = 0;
+    if (args.contains("--tessellation")) {
+        std::printf("\n%-26s %10s %10s %10s %10s %8s %8s %9s %9s %8s\n", "outline tessellation", "verts/part",
+                    "old verts", "render ms", "old ms", "max err", "old max", "mean err", "old mean", "result");
+        for (const BenchCase& bench : benchCases()) {
+            if (!hasOutline(bench.params)) continue;
+            TextureGenerator::BenchOptions legacy;
+            legacy.legacyOutlineSteps = true;
+            Timing t = measure(bench.params, iterations);
+            Timing l = measure(bench.params, iterations, &legacy);
+            OutlineError error = outlineError(bench.params);
+            if (!error.ok()) exitCode = 1;
+
+            double perParticle = (double)t.vertices / std::max<size_t>(1, t.particles);
+            double legacyPerParticle = (double)l.vertices / std::max<size_t>(1, l.particles);
+            std::printf("%-26s %10.1f %10.1f %10.2f %10.2f %8d %8d %9.4f %9.4f %8s\n", bench.name, perParticle,
+                        legacyPerParticle, t.renderMs, l.renderMs, error.maxDiff, error.legacyMaxDiff, error.meanDiff,
+                        error.legacyMeanDiff, error.ok() ? "pass" : "WORSE");
+        }
+    }
+    if (args.contains("--abr")) {
+        std::printf("\n%-26s %10s %10s %10s %8s\n", "abr round trip", "bytes", "write ms", "read ms", "result");
+        for (const BenchCase& bench : benchCases()) {
+            if (bench.params.count > 100000) continue;
+            QImage coverage = TextureGenerator::renderCoverage(bench.params, TextureGenerator::place(bench.params));
+            QElapsedTimer timer;
+            timer.start();
+            QByteArray data = AbrWriter::abrData(coverage, bench.name);
+            double writeMs = timer.nsecsElapsed() / 1e6;
+            timer.restart();
+            AbrReader reader;
+            QImage decoded = reader.open(data) && reader.count() == 1 ? reader.image(0) : QImage();
+            double readMs = timer.nsecsElapsed() / 1e6;
+            std::printf("%-26s %10lld %10.2f %10.2f %8s\n", bench.name, (long long)data.size(), writeMs, readMs,
+                        decoded == coverage ? "ok" : "MISMATCH");
+        }
+
+        int fileIndex = args.indexOf("--abr") + 1;
+        if (fileIndex < args.size() && !args[fileIndex].startsWith("--")) {
+            QElapsedTimer timer;
+            timer.start();
+            AbrReader reader;
+            if (!reader.open(args[fileIndex])) {
+                std::printf("\n%s: %s\n", qPrintable(args[fileIndex]), qPrintable(reader.errorString()));
+                return 1;
+            }
+            double openMs = timer.nsecsElapsed() / 1e6;
+            timer.restart();
+            int failed = 0;
+            qint64 pixels = 0;
+            for (int i = 0; i < reader.count(); ++i) {
+                QImage image = reader.image(i);
+                if (image.isNull()) ++failed;
+                else pixels += (qint64)image.width() * image.height();
+            }
+            double decodeMs = timer.nsecsElapsed() / 1e6;
+            std::printf("\n%s: version %d, %d brushes, open %.2f ms, decode %.2f ms (%.1f Mpx), %d failed\n",
+                        qPrintable(args[fileIndex]), reader.version(), reader.count(), openMs, decodeMs, pixels / 1e6, failed);
+        }
+    }
+    return exitCode;
+}
@@ -1,7 +1,39 @@
 #include <QApplication>
+#include <QCoreApplication>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include "MainWindow.h"
+#include "MemoryTracker.h"
+#include "RenderServer.h"
+
+// Headless render daemon: brush-synth --serve [name] [--threads N] [--memory-ceiling MB]
+static int serve(int argc, char *argv[]) {
+    QCoreApplication app(argc, argv);
+
+    QString name = "brush-synth";
+    int threads = 0;
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--serve") == 0 && i + 1 < argc && argv[i + 1][0] != '-') name = argv[++i];
+        else if (std::strcmp(argv[i], "--threads") == 0 && i + 1 < argc) threads = std::atoi(argv[++i]);
+        else if (std::strcmp(argv[i], "--memory-ceiling") == 0 && i + 1 < argc) {
+            MemoryTracker::instance().setCeiling((qint64)std::atoi(argv[++i]) << 20);
+        }
+    }
+
+    RenderServer server;
+    if (!server.listen(name, threads)) {
+        std::fprintf(stderr, "brush-synth: cannot listen on %s: %s\n", qPrintable(name), qPrintable(server.errorString()));
+        return 1;
+    }
+    return app.exec();
+}
 
 int main(int argc, char *argv[]) {
+    for (int i = 1; i < argc; ++i) {
+        if (std::strcmp(argv[i], "--serve") == 0) return serve(argc, argv);
+    }
+
     QApplication app(argc, argv);
     
     MainWindow w;